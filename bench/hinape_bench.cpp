@@ -0,0 +1,142 @@
+// Headless benchmarks of the physics kernels, linked against HinaPhysics only (no SDL / GL).
+//
+//      hinape_bench --benchmark_out=bench.json --benchmark_out_format=json --benchmark_repetitions=5
+//
+// Every scene is built from fixed parameters and seeds, so the JSON of two runs on the same box can be diffed to spot
+// regressions. The `bench_json` target runs the suite that way.
+
+#include "physics/physics_system.h"
+#include "physics/factory/physics_objects_factory.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <random>
+#include <thread>
+
+namespace
+{
+auto make_cloth(int resolution) -> std::shared_ptr<HinaPE::PhysicsObject>
+{
+    HinaPE::ClothFactory::ClothDesc desc{Vec3(0.f, 1.f, 0.f), Vec3(0.f), 1.f, 1.f, resolution, resolution, 1.f, 1000.f};
+    auto cloth = HinaPE::ClothFactory::create_cloth(desc);
+    auto &inv_masses = cloth->get_object<HinaPE::DeformableBase<HinaPE::CLOTH>>().inv_masses();
+    inv_masses[(resolution - 1) * resolution] = 0; // pin two corners so that the cloth swings instead of falling
+    inv_masses[resolution * resolution - 1] = 0;
+    return cloth;
+}
+
+// SPH: a resting block of fluid, args: particle count
+void BM_SPHStep(benchmark::State &state)
+{
+    const auto n = static_cast<int>(state.range(0));
+    const float spacing = 0.05f;
+    HinaPE::SPHKernel sph;
+    sph.h = 2 * spacing;
+    sph.targetDensity = 1000.f;
+    sph.MASS = sph.targetDensity * spacing * spacing * spacing;
+    sph.self_density = sph.MASS * 315.0f / (64.0f * 3.14f * std::pow(sph.h, 3));
+    sph.eosScale = 1000.f;
+    sph.eosExponent = 7.f;
+    sph.viscosity = 0.01f;
+
+    const int side = static_cast<int>(std::ceil(std::cbrt(static_cast<double>(n))));
+    sph.particles.reserve(n);
+    for (int i = 0; i < n; ++i)
+        sph.add_particle(Vec3(static_cast<float>(i % side), static_cast<float>(i / side % side), static_cast<float>(i / (side * side))) * spacing);
+
+    for (auto _: state)
+        sph.simulate(1e-3f);
+    state.SetItemsProcessed(state.iterations() * n);
+    state.counters["particles"] = n;
+}
+BENCHMARK(BM_SPHStep)->Arg(10'000)->Arg(100'000)->Arg(1'000'000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// fast mass-spring: one pinned cloth, args: vertices per side, self-collision on / off (thickness as in BM_PBDCloth)
+void BM_FMSCloth(benchmark::State &state)
+{
+    const auto resolution = static_cast<int>(state.range(0));
+    HinaPE::PhysicsSystem physics_system; // a fresh context per run, so that no state of the last scene is left
+    auto &kernel = physics_system._use_kernel_<HinaPE::FastMassSpringKernel>();
+    kernel.opt.iterations = 10;
+    kernel.opt.tolerance = 0.f;
+    kernel.opt.self_collision = state.range(1) != 0;
+    kernel.opt.self_collision_opt.thickness = 0.5f / static_cast<float>(resolution - 1);
+    physics_system._register_(1, make_cloth(resolution));
+
+    for (auto _: state)
+        physics_system._tick_(1 / 60.f);
+    state.SetItemsProcessed(state.iterations() * resolution * resolution);
+    state.counters["vertices"] = resolution * resolution;
+}
+BENCHMARK(BM_FMSCloth)->ArgsProduct({{16, 32, 64, 128}, {0, 1}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// PBD: one pinned cloth, args: vertices per side, self-collision on / off; the thickness is half an edge so that the
+// self-collision numbers measure folds, not neighbouring triangles pushing each other apart
+void BM_PBDCloth(benchmark::State &state)
+{
+    const auto resolution = static_cast<int>(state.range(0));
+    HinaPE::PhysicsSystem physics_system;
+    auto &kernel = physics_system._use_kernel_<HinaPE::PBDKernel>();
+    kernel.opt.iterations = 10;
+    kernel.opt.self_collision = state.range(1) != 0;
+    kernel.opt.self_collision_opt.thickness = 0.5f / static_cast<float>(resolution - 1);
+    physics_system._register_(1, make_cloth(resolution));
+
+    for (auto _: state)
+        physics_system._tick_(1 / 60.f);
+    state.SetItemsProcessed(state.iterations() * resolution * resolution);
+    state.counters["vertices"] = resolution * resolution;
+}
+BENCHMARK(BM_PBDCloth)->ArgsProduct({{32, 64, 128}, {0, 1}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// broadphase: dynamic bodies jittering in a box of constant density, args: body count, method
+void BM_Broadphase(benchmark::State &state)
+{
+    const auto n = static_cast<int>(state.range(0));
+    HinaPE::PhysicsSystem physics_system;
+    physics_system.collision.opt.method = state.range(1) == 0 ? HinaPE::SimpleCollision::Method::AABBTree : HinaPE::SimpleCollision::Method::SweepAndPrune;
+
+    std::mt19937 rng(7);
+    const float extent = std::cbrt(static_cast<float>(n)) * 0.5f; // about one body per unit cube
+    std::uniform_real_distribution<float> position(-extent, extent), jitter(-0.02f, 0.02f);
+    std::vector<std::shared_ptr<HinaPE::PhysicsObject>> bodies;
+    for (int i = 0; i < n; ++i)
+    {
+        auto body = HinaPE::RigidBodyFactory::create_rigidbody(HinaPE::DYNAMIC);
+        body->set_position(Vec3(position(rng), position(rng), position(rng)));
+        physics_system._register_(i, body);
+        bodies.push_back(body);
+    }
+    physics_system.collision.update();
+
+    for (auto _: state)
+    {
+        state.PauseTiming();
+        for (auto &body: bodies)
+            body->set_position(body->get_position() + Vec3(jitter(rng), jitter(rng), jitter(rng)));
+        state.ResumeTiming();
+        physics_system.collision.update();
+        benchmark::DoNotOptimize(physics_system.collision.pairs().data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    state.counters["pairs"] = static_cast<double>(physics_system.collision.counters().pairs_found);
+}
+BENCHMARK(BM_Broadphase)->ArgsProduct({{1'000, 10'000, 100'000}, {0, 1}})->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+int main(int argc, char **argv)
+{
+    benchmark::AddCustomContext("hardware_concurrency", std::to_string(std::thread::hardware_concurrency()));
+#ifdef HINAPE_TBB_SUPPORT
+    benchmark::AddCustomContext("parallel_backend", "tbb");
+#else
+    benchmark::AddCustomContext("parallel_backend", "task_scheduler");
+#endif
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
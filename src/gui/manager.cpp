@@ -549,7 +549,7 @@ Mode Manager::item_options(Undo &undo, Mode cur_mode, Scene_Item &item, Pose &ol
                         ImGui::RadioButton("Kinematic", &rt, 2);
                         if (rt != pre_rt)
                         {
-                            obj.physics_object->switch_rigidbody_type(static_cast<HinaPE::RigidBodyType>(rt));
+                            HinaPE::PhysicsSystem::instance()._switch_rigidbody_type_(obj.id(), static_cast<HinaPE::RigidBodyType>(rt)); // not in place: the simulation thread may be stepping the body
                             pre_rt = rt;
                         }
                         // TODO: display rigidbody info
@@ -1154,7 +1154,7 @@ void Manager::UInew_obj(Undo &undo)
             auto &inds = cloth->get_indices();
             //            Halfedge_Mesh hm;
             //            hm.from_mesh(Util::Gen::generate(verts, inds));
-            Scene_Object &obj = undo.add_obj(Util::Gen::generate(verts, inds), "Cloth");
+            Scene_Object &obj = undo.add_obj(Util::Gen::generate(verts.to_vector(), inds), "Cloth");
             //            Scene_Object &obj = undo.add_obj(std::move(hm), "Cloth");
             obj.attach_physics_object(cloth);
             obj.set_mesh_dirty();
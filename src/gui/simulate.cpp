@@ -1,5 +1,6 @@
 #include "../geometry/util.h"
 #include "../scene/renderer.h"
+#include "../physics/util/profiler.h"
 
 #include "manager.h"
 #include "simulate.h"
@@ -27,9 +28,11 @@ auto Simulate::keydown(Widgets &widgets, Undo &undo, SDL_Keysym key) -> bool
 
 void Simulate::step(Scene &scene, float dt)
 {
-    if (HinaPE::PhysicsSystem::instance().running)
-        for (int i = 0; i < HinaPE::PhysicsSystem::instance().sub_step; ++i)
-            HinaPE::PhysicsSystem::instance()._tick_(dt / (float) 5); // TODO: move this to separate physics thread;
+    auto &physics_system = HinaPE::PhysicsSystem::instance();
+    if (physics_system.is_async())
+        physics_system._fetch_(); // the simulation thread steps on its own, just pick up its latest state
+    else if (physics_system.running)
+        physics_system._advance_(dt); // fixed steps, the scene interpolates between the last two by alpha()
     scene.for_items([this, dt](Scene_Item &item) { item.step(scene_obj, dt); });
 }
 
@@ -163,6 +166,76 @@ auto Simulate::UIsidebar(Manager &manager, Scene &scene, Undo &undo, Widgets &wi
         build_scene(scene);
     }
 
+    if (ImGui::CollapsingHeader("Physics Thread"))
+    {
+        ImGui::PushID(idx++);
+        auto &physics_system = HinaPE::PhysicsSystem::instance();
+        static HinaPE::PhysicsSystem::AsyncOpt async_opt;
+        static int back_pressure = 0;
+        static int n_steps = 1;
+        bool async = physics_system.is_async();
+        if (!async)
+        {
+            ImGui::DragFloat("Step dt", &physics_system.step_opt.fixed_dt, 0.001f, 0.001f, 0.1f, "%.3f");
+            ImGui::DragInt("Max Steps", &physics_system.step_opt.max_steps, 1, 1, 16);
+            ImGui::DragInt("Substeps", &physics_system.sub_step, 1, 1, 64);
+            ImGui::Checkbox("Adaptive Substeps", &physics_system.step_opt.adaptive_substeps);
+            if (physics_system.step_opt.adaptive_substeps)
+                ImGui::DragFloat("CFL", &physics_system.step_opt.cfl, 0.01f, 0.01f, 1.0f, "%.2f");
+            ImGui::Text("Substeps taken %d, alpha %.2f", physics_system.last_substeps(), physics_system.alpha());
+            static bool record_timeline = false;
+            static int seek_frame = 0;
+            if (ImGui::Checkbox("Record Timeline", &record_timeline))
+                physics_system._record_timeline_(record_timeline);
+            if (record_timeline)
+            {
+                ImGui::DragInt("Snapshot Interval", &physics_system.timeline_opt.interval, 1, 1, 600);
+                ImGui::DragInt("Seek Frame", &seek_frame, 1, 0, std::numeric_limits<int>::max());
+                ImGui::SameLine();
+                if (ImGui::Button("Seek"))
+                    physics_system._seek_(seek_frame, physics_system.step_opt.fixed_dt);
+                ImGui::Text("Frame %llu", physics_system.current_frame());
+            }
+            ImGui::DragFloat("Fixed dt", &async_opt.fixed_dt, 0.001f, 0.001f, 0.1f, "%.3f");
+            ImGui::Combo("Back Pressure", &back_pressure, "Drop Frames\0Block\0");
+        }
+        if (ImGui::Checkbox("Run Asynchronously", &async))
+        {
+            async_opt.back_pressure = static_cast<HinaPE::PhysicsSystem::BackPressure>(back_pressure);
+            if (async)
+                physics_system._launch_async_(async_opt);
+            else
+                physics_system._terminate_async_();
+        }
+        if (ImGui::Button(physics_system.running ? "Pause" : "Start"))
+        {
+            if (physics_system.running)
+                physics_system._pause_();
+            else
+                physics_system._start_();
+        }
+        if (async)
+        {
+            ImGui::SameLine();
+            if (ImGui::Button("Step"))
+                physics_system._step_(n_steps);
+            ImGui::SameLine();
+            ImGui::DragInt("Steps", &n_steps, 1, 1, 1000);
+            ImGui::Text("Frame %llu, dropped %llu", physics_system._state_().frame, physics_system.dropped_frames.load());
+        }
+        auto &profiler = HinaPE::Profiler::instance();
+        bool profiling = profiler.enabled();
+        if (ImGui::Checkbox("Profile", &profiling))
+            profiler.enable(profiling);
+        ImGui::SameLine();
+        if (ImGui::Button("Export Trace"))
+            profiler.write_chrome_trace("hinape_trace.json"); // chrome://tracing
+        ImGui::SameLine();
+        if (ImGui::Button("Clear Trace"))
+            profiler.clear();
+        ImGui::PopID();
+    }
+
     if (ImGui::CollapsingHeader("Add New Emitter"))
     {
         ImGui::PushID(idx++);
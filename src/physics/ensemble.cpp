@@ -0,0 +1,74 @@
+#include "ensemble.h"
+#include "util/parallel_lib/parallel_for.h"
+#include "util/profiler.h"
+
+#include <chrono>
+#include <exception>
+
+HinaPE::Ensemble::Ensemble(int variants, const Setup &setup)
+{
+    for (int i = 0; i < variants; ++i)
+    {
+        auto &system = *systems.emplace_back(std::make_unique<PhysicsSystem>());
+        if (setup)
+            setup(system, i);
+    }
+    reports.resize(systems.size());
+}
+
+auto HinaPE::Ensemble::run(int frames, float dt, const Output &output) -> void
+{
+    HINAPE_PROFILE_ZONE("ensemble.run");
+    for (auto &system: systems)
+    {
+        if (opt.deterministic)
+            system->_set_deterministic_(true);
+        if (auto *fms = system->current_kernel<FastMassSpringKernel>()) // picked in setup or since, share from now on
+            fms->share_factors(factors);
+    }
+
+    parallel_for(0, size(), [&](int i)
+    {
+        HINAPE_PROFILE_ZONE("ensemble.variant");
+        auto &system = *systems[i];
+        auto &report = reports[i];
+        report = {};
+        const auto begin = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            try
+            {
+                system._frame_(dt);
+                if (output)
+                    output(i, frame, system);
+                ++report.frames;
+            } catch (const std::exception &e)
+            {
+                report.error = e.what();
+                if (opt.stop_on_error)
+                    break;
+            }
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }, ExecutionPolicy::kParallel, 1);
+}
+
+auto HinaPE::Ensemble::size() const -> int
+{
+    return static_cast<int>(systems.size());
+}
+
+auto HinaPE::Ensemble::variant(int i) -> PhysicsSystem &
+{
+    return *systems[i];
+}
+
+auto HinaPE::Ensemble::report(int i) const -> const Report &
+{
+    return reports[i];
+}
+
+auto HinaPE::Ensemble::shared_factorizations() const -> size_t
+{
+    return factors->size();
+}
@@ -0,0 +1,59 @@
+#ifndef HINAPE_ENSEMBLE_H
+#define HINAPE_ENSEMBLE_H
+
+#include "physics_system.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace HinaPE
+{
+// N variants of one scene, each in its own PhysicsSystem, stepped concurrently: a parameter sweep in one process.
+//
+//      Ensemble ensemble(8, [](PhysicsSystem &system, int variant)
+//      {
+//          system._use_kernel_<FastMassSpringKernel>().opt.damping_factor = 0.9f + 0.01f * variant;
+//          system._register_(1, ClothFactory::create_cloth(desc));
+//      });
+//      ensemble.run(600, 1 / 60.f, [](int variant, int frame, PhysicsSystem &system) { /* write the frame */ });
+//
+// Variants are handed out to the thread pool one per task, the kernels' own parallel loops nest inside. Read-only solver
+// data is shared: variants using the FastMassSpringKernel whose cloths agree on topology, rest shape, stiffness and dt
+// (the damping above only enters the right hand side) build and hold one factorization between them.
+class Ensemble
+{
+public:
+    using Setup = std::function<void(PhysicsSystem &system, int variant)>; // build the scene of one variant and set its options
+    using Output = std::function<void(int variant, int frame, PhysicsSystem &system)>; // after every frame, on the thread stepping the variant
+
+    struct Opt
+    {
+        bool deterministic = false; // record the state hash of every frame, see PhysicsSystem::_set_deterministic_
+        bool stop_on_error = true; // a variant whose frame throws stops, the others go on
+    };
+    Opt opt;
+
+    struct Report
+    {
+        int frames = 0; // frames completed, one that threw is not counted
+        double seconds = 0; // wall time spent stepping (output included)
+        std::string error; // what() of the last exception thrown by a frame, empty if none
+    };
+
+    Ensemble(int variants, const Setup &setup); // setup runs serially, in variant order
+    auto run(int frames, float dt, const Output &output = {}) -> void; // frames of dt for every variant, returns when all are done
+    auto size() const -> int;
+    auto variant(int i) -> PhysicsSystem &;
+    auto report(int i) const -> const Report &; // of the last run()
+    auto shared_factorizations() const -> size_t; // distinct mass-spring factorizations held by the variants
+
+private:
+    std::vector<std::unique_ptr<PhysicsSystem>> systems;
+    std::vector<Report> reports;
+    std::shared_ptr<FastMassSpringKernel::FactorCache> factors = std::make_shared<FastMassSpringKernel::FactorCache>();
+};
+}
+
+#endif //HINAPE_ENSEMBLE_H
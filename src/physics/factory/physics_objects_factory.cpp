@@ -35,9 +35,9 @@ auto HinaPE::ClothFactory::create_cloth(const HinaPE::ClothFactory::ClothDesc &d
     auto bias_y = (float) height / 2.f;
 
     _ps.reserve(row * col);
-    _vs.reserve(row * col);
-    _ms.reserve(row * col);
-    _ims.reserve(row * col);
+    _vs.resize(row * col);
+    _ms.resize(row * col);
+    _ims.resize(row * col);
     _is.reserve(6 * (row - 1) * (col - 1));
 
     for (int j = 0; j < row; ++j)
@@ -78,7 +78,7 @@ auto HinaPE::ClothFactory::create_cloth(const HinaPE::ClothFactory::ClothDesc &d
         }
     }
 
-    std::fill(_vs.begin(), _vs.end(), Vec3(0.f, 0.f, 0.f));
+    _vs.fill(Vec3(0.f, 0.f, 0.f));
     std::fill(_ms.begin(), _ms.end(), desc.mass);
     std::fill(_ims.begin(), _ims.end(), 1.f / desc.mass);
 
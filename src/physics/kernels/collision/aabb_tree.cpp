@@ -0,0 +1,259 @@
+#include "aabb_tree.h"
+
+#include <cassert>
+
+namespace
+{
+auto merge(const BBox &a, const BBox &b) -> BBox
+{
+    BBox res = a;
+    res.enclose(b);
+    return res;
+}
+auto contains(const BBox &outer, const BBox &inner) -> bool
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z && inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+}
+}
+
+auto HinaPE::DynamicAABBTree::create_proxy(const BBox &box, unsigned int user_data, bool is_static) -> int
+{
+    int proxy = allocate_node();
+    nodes[proxy].box = fatten(box, Vec3(0.f));
+    nodes[proxy].user_data = user_data;
+    nodes[proxy].is_static = is_static;
+    nodes[proxy].height = 0;
+    insert_leaf(proxy);
+    return proxy;
+}
+
+auto HinaPE::DynamicAABBTree::destroy_proxy(int proxy) -> void
+{
+    assert(nodes[proxy].is_leaf());
+    remove_leaf(proxy);
+    free_node(proxy);
+}
+
+auto HinaPE::DynamicAABBTree::move_proxy(int proxy, const BBox &box, const Vec3 &displacement) -> bool
+{
+    assert(nodes[proxy].is_leaf());
+    if (contains(nodes[proxy].box, box))
+        return false;
+    remove_leaf(proxy);
+    nodes[proxy].box = fatten(box, displacement);
+    insert_leaf(proxy);
+    return true;
+}
+
+auto HinaPE::DynamicAABBTree::set_static(int proxy, bool is_static) -> bool
+{
+    assert(nodes[proxy].is_leaf());
+    if (nodes[proxy].is_static == is_static)
+        return false;
+    nodes[proxy].is_static = is_static;
+    return true;
+}
+
+auto HinaPE::DynamicAABBTree::fat_box(int proxy) const -> const BBox &
+{
+    return nodes[proxy].box;
+}
+
+auto HinaPE::DynamicAABBTree::user_data(int proxy) const -> unsigned int
+{
+    return nodes[proxy].user_data;
+}
+
+auto HinaPE::DynamicAABBTree::is_static(int proxy) const -> bool
+{
+    return nodes[proxy].is_static;
+}
+
+auto HinaPE::DynamicAABBTree::height() const -> int
+{
+    return root == null ? 0 : nodes[root].height;
+}
+
+auto HinaPE::DynamicAABBTree::clear() -> void
+{
+    nodes.clear();
+    root = null;
+    free_list = null;
+}
+
+auto HinaPE::DynamicAABBTree::allocate_node() -> int
+{
+    if (free_list == null)
+    {
+        nodes.emplace_back();
+        return static_cast<int>(nodes.size() - 1);
+    }
+    int node = free_list;
+    free_list = nodes[node].parent;
+    nodes[node] = Node{};
+    return node;
+}
+
+auto HinaPE::DynamicAABBTree::free_node(int node) -> void
+{
+    nodes[node].parent = free_list;
+    nodes[node].height = -1;
+    free_list = node;
+}
+
+auto HinaPE::DynamicAABBTree::insert_leaf(int leaf) -> void
+{
+    if (root == null)
+    {
+        root = leaf;
+        nodes[root].parent = null;
+        return;
+    }
+
+    // find the best sibling, by the surface area heuristic
+    BBox leaf_box = nodes[leaf].box;
+    int index = root;
+    while (!nodes[index].is_leaf())
+    {
+        int left = nodes[index].left, right = nodes[index].right;
+        float area = nodes[index].box.surface_area();
+        float combined_area = merge(nodes[index].box, leaf_box).surface_area();
+        float cost = 2.f * combined_area; // cost of a new parent for this node and the leaf
+        float inheritance_cost = 2.f * (combined_area - area); // minimum cost of pushing the leaf further down
+
+        auto descend_cost = [&](int child)
+        {
+            float merged = merge(leaf_box, nodes[child].box).surface_area();
+            return nodes[child].is_leaf() ? merged + inheritance_cost : merged - nodes[child].box.surface_area() + inheritance_cost;
+        };
+        float cost_left = descend_cost(left), cost_right = descend_cost(right);
+        if (cost < cost_left && cost < cost_right)
+            break;
+        index = cost_left < cost_right ? left : right;
+    }
+    int sibling = index;
+
+    // create a new parent
+    int old_parent = nodes[sibling].parent;
+    int new_parent = allocate_node();
+    nodes[new_parent].parent = old_parent;
+    nodes[new_parent].box = merge(leaf_box, nodes[sibling].box);
+    nodes[new_parent].height = nodes[sibling].height + 1;
+    nodes[new_parent].left = sibling;
+    nodes[new_parent].right = leaf;
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+    if (old_parent == null)
+        root = new_parent;
+    else if (nodes[old_parent].left == sibling)
+        nodes[old_parent].left = new_parent;
+    else
+        nodes[old_parent].right = new_parent;
+
+    // walk back up, fixing heights and boxes
+    index = nodes[leaf].parent;
+    while (index != null)
+    {
+        index = balance(index);
+        int left = nodes[index].left, right = nodes[index].right;
+        nodes[index].height = 1 + std::max(nodes[left].height, nodes[right].height);
+        nodes[index].box = merge(nodes[left].box, nodes[right].box);
+        index = nodes[index].parent;
+    }
+}
+
+auto HinaPE::DynamicAABBTree::remove_leaf(int leaf) -> void
+{
+    if (leaf == root)
+    {
+        root = null;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grand_parent = nodes[parent].parent;
+    int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    if (grand_parent == null)
+    {
+        root = sibling;
+        nodes[sibling].parent = null;
+        free_node(parent);
+        return;
+    }
+
+    // replace the parent by the sibling
+    if (nodes[grand_parent].left == parent)
+        nodes[grand_parent].left = sibling;
+    else
+        nodes[grand_parent].right = sibling;
+    nodes[sibling].parent = grand_parent;
+    free_node(parent);
+
+    int index = grand_parent;
+    while (index != null)
+    {
+        index = balance(index);
+        int left = nodes[index].left, right = nodes[index].right;
+        nodes[index].box = merge(nodes[left].box, nodes[right].box);
+        nodes[index].height = 1 + std::max(nodes[left].height, nodes[right].height);
+        index = nodes[index].parent;
+    }
+}
+
+auto HinaPE::DynamicAABBTree::balance(int a) -> int
+{
+    // AVL rotation: promote the higher grandchild when |height(b) - height(c)| > 1, return the new subtree root
+    if (nodes[a].is_leaf() || nodes[a].height < 2)
+        return a;
+
+    int b = nodes[a].left, c = nodes[a].right;
+    int diff = nodes[c].height - nodes[b].height;
+    if (diff > 1 || diff < -1)
+    {
+        // rotate the higher child x up, y is the lower one
+        int x = diff > 1 ? c : b;
+        int y = diff > 1 ? b : c;
+        int f = nodes[x].left, g = nodes[x].right;
+
+        // swap a and x
+        nodes[x].left = a;
+        nodes[x].parent = nodes[a].parent;
+        nodes[a].parent = x;
+        if (nodes[x].parent == null)
+            root = x;
+        else if (nodes[nodes[x].parent].left == a)
+            nodes[nodes[x].parent].left = x;
+        else
+            nodes[nodes[x].parent].right = x;
+
+        // the higher grandchild stays under x, the lower one goes under a next to y
+        int keep = nodes[f].height > nodes[g].height ? f : g;
+        int move = keep == f ? g : f;
+        nodes[x].right = keep;
+        nodes[a].left = y;
+        nodes[a].right = move;
+        nodes[move].parent = a;
+        nodes[a].box = merge(nodes[y].box, nodes[move].box);
+        nodes[a].height = 1 + std::max(nodes[y].height, nodes[move].height);
+        nodes[x].box = merge(nodes[a].box, nodes[keep].box);
+        nodes[x].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+        return x;
+    }
+    return a;
+}
+
+auto HinaPE::DynamicAABBTree::fatten(const BBox &box, const Vec3 &displacement) const -> BBox
+{
+    Vec3 margin(opt.fat_margin);
+    BBox res(box.min - margin, box.max + margin);
+    Vec3 d = displacement * opt.displacement_multiplier;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (d[i] < 0)
+            res.min[i] += d[i];
+        else
+            res.max[i] += d[i];
+    }
+    return res;
+}
@@ -0,0 +1,96 @@
+#ifndef HINAPE_AABB_TREE_H
+#define HINAPE_AABB_TREE_H
+
+#include "lib/bbox.h"
+
+#include <vector>
+
+namespace HinaPE
+{
+inline auto overlaps(const BBox &a, const BBox &b) -> bool
+{
+    return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y && a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+// Incremental dynamic AABB tree (in the spirit of Box2D's b2DynamicTree).
+// Leaves store fattened boxes, a proxy is only re-inserted when its tight box escapes the fat one.
+class DynamicAABBTree
+{
+public:
+    struct Opt
+    {
+        float fat_margin = 0.1f; // added on every side of a tight box
+        float displacement_multiplier = 2.f; // fat boxes are also stretched along the predicted displacement
+    };
+    Opt opt;
+
+    auto create_proxy(const BBox &box, unsigned int user_data, bool is_static = false) -> int;
+    auto destroy_proxy(int proxy) -> void;
+    auto move_proxy(int proxy, const BBox &box, const Vec3 &displacement) -> bool; // return true if re-inserted
+    auto set_static(int proxy, bool is_static) -> bool; // return true if it changed
+    auto fat_box(int proxy) const -> const BBox &;
+    auto user_data(int proxy) const -> unsigned int;
+    auto is_static(int proxy) const -> bool; // stored in the leaf, so that queries need no lookup to filter static pairs
+    auto height() const -> int;
+    auto clear() -> void;
+
+    template<typename Callback>
+    auto query(const BBox &box, Callback &&callback) const -> size_t; // callback(proxy) for every overlapping leaf, return overlap tests done
+
+private:
+    static constexpr int null = -1;
+    struct Node
+    {
+        BBox box;
+        int parent = null; // next free node when unused
+        int left = null;
+        int right = null;
+        int height = -1; // 0 for leaves, -1 for free nodes
+        unsigned int user_data = 0;
+        bool is_static = false;
+
+        auto is_leaf() const -> bool { return left == null; }
+    };
+
+    auto allocate_node() -> int;
+    auto free_node(int node) -> void;
+    auto insert_leaf(int leaf) -> void;
+    auto remove_leaf(int leaf) -> void;
+    auto balance(int a) -> int;
+    auto fatten(const BBox &box, const Vec3 &displacement) const -> BBox;
+
+    std::vector<Node> nodes;
+    int root = null;
+    int free_list = null;
+};
+
+template<typename Callback>
+auto DynamicAABBTree::query(const BBox &box, Callback &&callback) const -> size_t
+{
+    size_t tests = 0;
+    if (root == null)
+        return tests;
+    thread_local std::vector<int> stack;
+    stack.clear();
+    stack.push_back(root);
+    while (!stack.empty())
+    {
+        int index = stack.back();
+        stack.pop_back();
+        const Node &node = nodes[index];
+        ++tests;
+        if (!overlaps(node.box, box))
+            continue;
+        if (node.is_leaf())
+            callback(index);
+        else
+        {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+    return tests;
+}
+}
+
+#endif //HINAPE_AABB_TREE_H
@@ -0,0 +1,458 @@
+#include "cloth_self_collision.h"
+#include "proximity.h"
+#include "aabb_tree.h"
+#include "../../util/parallel_lib/parallel_for.h"
+#include "../../util/profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+auto HinaPE::ClothSelfCollision::Counters::operator+=(const Counters &other) -> Counters &
+{
+    candidate_pairs += other.candidate_pairs;
+    vertex_triangle += other.vertex_triangle;
+    edge_edge += other.edge_edge;
+    resolved += other.resolved;
+    rebuilds += other.rebuilds;
+    return *this;
+}
+
+auto HinaPE::ClothSelfCollision::set_topology(const Vec3Stream &x, const std::vector<int> &indices, const std::vector<std::pair<int, int>> &_edges) -> void
+{
+    rest = x;
+    edges.resize(_edges.size());
+    double length = 0;
+    min_edge_length = std::numeric_limits<float>::infinity();
+    for (size_t e = 0; e < _edges.size(); ++e)
+    {
+        edges[e] = {static_cast<unsigned int>(_edges[e].first), static_cast<unsigned int>(_edges[e].second)};
+        float l = (x.get(edges[e][0]) - x.get(edges[e][1])).norm();
+        length += l;
+        min_edge_length = std::min(min_edge_length, l);
+    }
+    mean_edge_length = edges.empty() ? 0.f : static_cast<float>(length / (double) edges.size());
+
+    edge_rest_centres.resize(edges.size());
+    edge_rest_radii.resize(edges.size());
+    for (size_t e = 0; e < edges.size(); ++e)
+    {
+        edge_rest_centres[e] = 0.5f * (x.get(edges[e][0]) + x.get(edges[e][1]));
+        edge_rest_radii[e] = 0.5f * (x.get(edges[e][0]) - x.get(edges[e][1])).norm();
+    }
+
+    triangles.resize(indices.size() / 3);
+    triangle_rest_centres.resize(triangles.size());
+    triangle_rest_radii.resize(triangles.size());
+    for (size_t t = 0; t < triangles.size(); ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+            triangles[t][k] = static_cast<unsigned int>(indices[3 * t + k]);
+        Vec3 a = x.get(triangles[t][0]), b = x.get(triangles[t][1]), c = x.get(triangles[t][2]);
+        triangle_rest_centres[t] = (a + b + c) / 3.f;
+        triangle_rest_radii[t] = std::max({(a - triangle_rest_centres[t]).norm(), (b - triangle_rest_centres[t]).norm(), (c - triangle_rest_centres[t]).norm()});
+    }
+    built = false;
+}
+
+auto HinaPE::ClothSelfCollision::solve(Vec3Stream &x, const std::vector<float> &inv_masses) -> void
+{
+    stats = {};
+    if (triangles.empty())
+        return;
+    if (needs_rebuild(x))
+        build_candidates(x, inv_masses);
+    detect(x);
+    resolve(x, inv_masses);
+}
+
+auto HinaPE::ClothSelfCollision::counters() const -> const Counters &
+{
+    return stats;
+}
+
+auto HinaPE::ClothSelfCollision::thickness() const -> float
+{
+    // a thicker layer than the shortest edge pushes the triangles around it apart, the cloth would never rest
+    return std::min(opt.thickness, min_edge_length);
+}
+
+auto HinaPE::ClothSelfCollision::invalidate() -> void
+{
+    built = false;
+}
+
+auto HinaPE::ClothSelfCollision::SpatialHash::cell_of(const Vec3 &p) const -> std::array<int, 3>
+{
+    return {static_cast<int>(std::floor(p.x / cell)), static_cast<int>(std::floor(p.y / cell)), static_cast<int>(std::floor(p.z / cell))};
+}
+
+auto HinaPE::ClothSelfCollision::SpatialHash::bucket_of(int i, int j, int k) const -> unsigned int
+{
+    auto h = static_cast<unsigned int>(i) * 73856093u ^ static_cast<unsigned int>(j) * 19349663u ^ static_cast<unsigned int>(k) * 83492791u;
+    return h & static_cast<unsigned int>(bucket_start.size() - 2); // the table size is a power of two, plus the end marker
+}
+
+auto HinaPE::ClothSelfCollision::SpatialHash::build(const std::vector<BBox> &boxes) -> void
+{
+    // one entry per (box, overlapped cell)
+    const size_t n = boxes.size();
+    offsets.resize(n);
+    first_cells.resize(n);
+    parallel_for(static_cast<size_t>(0), n, [&](size_t b)
+    {
+        auto lo = cell_of(boxes[b].min), hi = cell_of(boxes[b].max);
+        first_cells[b] = lo;
+        offsets[b] = static_cast<unsigned int>((hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1));
+    });
+    const unsigned int total = parallel_exclusive_scan(offsets.begin(), offsets.end(), offsets.begin(), 0u);
+
+    size_t table_size = 64;
+    while (table_size < 2 * static_cast<size_t>(total))
+        table_size <<= 1;
+    bucket_start.assign(table_size + 1, 0);
+    entry_buckets.resize(total);
+    entry_items.resize(total);
+    parallel_for(static_cast<size_t>(0), n, [&](size_t b)
+    {
+        auto lo = cell_of(boxes[b].min), hi = cell_of(boxes[b].max);
+        unsigned int k = offsets[b];
+        for (int i = lo[0]; i <= hi[0]; ++i)
+            for (int j = lo[1]; j <= hi[1]; ++j)
+                for (int l = lo[2]; l <= hi[2]; ++l, ++k)
+                {
+                    entry_buckets[k] = bucket_of(i, j, l);
+                    entry_items[k] = static_cast<unsigned int>(b);
+                    std::atomic_ref<unsigned int>(bucket_start[entry_buckets[k]]).fetch_add(1, std::memory_order_relaxed);
+                }
+    });
+
+    // counting sort of the entries by bucket, every bucket is then sorted so the layout does not depend on the scheduling
+    parallel_exclusive_scan(bucket_start.begin(), bucket_start.end(), bucket_start.begin(), 0u);
+    bucket_cursor.assign(bucket_start.begin(), bucket_start.end() - 1);
+    items.resize(total);
+    parallel_for(static_cast<size_t>(0), static_cast<size_t>(total), [&](size_t k)
+    {
+        auto slot = std::atomic_ref<unsigned int>(bucket_cursor[entry_buckets[k]]).fetch_add(1, std::memory_order_relaxed);
+        items[slot] = entry_items[k];
+    });
+    parallel_for(static_cast<size_t>(0), table_size, [&](size_t b)
+    {
+        if (bucket_start[b + 1] - bucket_start[b] > 1)
+            std::sort(items.begin() + bucket_start[b], items.begin() + bucket_start[b + 1]);
+    });
+}
+
+auto HinaPE::ClothSelfCollision::needs_rebuild(const Vec3Stream &x) const -> bool
+{
+    if (!built || reference.size() != x.size())
+        return true;
+    // only relative motion changes the distances: measure the displacements around their mean, so a cloth that
+    // falls or is carried around as a whole keeps its candidates
+    const float skin = opt.skin > 0 ? opt.skin : thickness();
+    Vec3 mean = parallel_reduce(static_cast<size_t>(0), x.size(), Vec3(), [&](size_t b, size_t e, Vec3 init)
+    {
+        for (size_t i = b; i < e; ++i)
+            init += x.get(i) - reference.get(i);
+        return init;
+    }, [](const Vec3 &a, const Vec3 &b) { return a + b; }) / static_cast<float>(x.size());
+    float max_displacement = parallel_reduce(static_cast<size_t>(0), x.size(), 0.f, [&](size_t b, size_t e, float init)
+    {
+        for (size_t i = b; i < e; ++i)
+            init = std::max(init, (x.get(i) - reference.get(i) - mean).norm_squared());
+        return init;
+    }, [](float a, float b) { return std::max(a, b); });
+    return max_displacement > 0.25f * skin * skin; // two vertices closing in on each other cover the skin together
+}
+
+auto HinaPE::ClothSelfCollision::rest_vertex_triangle_closer(unsigned int v, unsigned int t, float r) const -> bool
+{
+    // the centre is a point of the triangle, so its distance bounds the closest one from above, and from below once the
+    // radius is taken off
+    Vec3 p = rest.get(v);
+    float to_centre = (p - triangle_rest_centres[t]).norm();
+    if (to_centre < r)
+        return true;
+    if (to_centre - triangle_rest_radii[t] >= r)
+        return false;
+    auto &tri = triangles[t];
+    Vec3 t0 = rest.get(tri[0]), t1 = rest.get(tri[1]), t2 = rest.get(tri[2]);
+    Vec3 bary = closest_point_on_triangle(p, t0, t1, t2);
+    return (p - (bary.x * t0 + bary.y * t1 + bary.z * t2)).norm_squared() < r * r;
+}
+
+auto HinaPE::ClothSelfCollision::rest_edge_edge_closer(unsigned int i, unsigned int j, float r) const -> bool
+{
+    float between_centres = (edge_rest_centres[i] - edge_rest_centres[j]).norm();
+    if (between_centres < r)
+        return true;
+    if (between_centres - edge_rest_radii[i] - edge_rest_radii[j] >= r)
+        return false;
+    Vec3 p0 = rest.get(edges[i][0]), p1 = rest.get(edges[i][1]), q0 = rest.get(edges[j][0]), q1 = rest.get(edges[j][1]);
+    float s, t;
+    closest_points_on_segments(p0, p1, q0, q1, s, t);
+    return ((p0 + s * (p1 - p0)) - (q0 + t * (q1 - q0))).norm_squared() < r * r;
+}
+
+auto HinaPE::ClothSelfCollision::build_candidates(const Vec3Stream &x, const std::vector<float> &inv_masses) -> void
+{
+    HINAPE_PROFILE_ZONE("self_collision.candidates");
+    // every pair closer than thickness + skin, they contain all contacts until some vertex moved skin / 2; pairs that
+    // close in the rest shape are neighbours on the surface, they are kept apart by the cloth constraints instead
+    const float r = thickness() + (opt.skin > 0 ? opt.skin : thickness());
+    reference = x;
+    built = true;
+    ++stats.rebuilds;
+
+    triangle_boxes.resize(triangles.size());
+    parallel_for(static_cast<size_t>(0), triangles.size(), [&](size_t t)
+    {
+        Vec3 a = x.get(triangles[t][0]), b = x.get(triangles[t][1]), c = x.get(triangles[t][2]);
+        triangle_boxes[t] = BBox(hmin(hmin(a, b), c) - Vec3(r), hmax(hmax(a, b), c) + Vec3(r));
+    });
+    edge_boxes.resize(edges.size());
+    parallel_for(static_cast<size_t>(0), edges.size(), [&](size_t e)
+    {
+        Vec3 a = x.get(edges[e][0]), b = x.get(edges[e][1]);
+        edge_boxes[e] = BBox(hmin(a, b) - Vec3(r / 2), hmax(a, b) + Vec3(r / 2)); // two boxes overlap when the edges are closer than r
+    });
+    triangle_hash.cell = edge_hash.cell = opt.cell_size > 0 ? opt.cell_size : mean_edge_length + 2 * r; // a grown triangle spans at most two cells per axis
+    triangle_hash.build(triangle_boxes);
+    edge_hash.build(edge_boxes);
+
+    // every chunk collects its candidates locally and appends them once
+    std::mutex mutex;
+    auto merge = [&](std::vector<std::array<unsigned int, 2>> &to, const std::vector<std::array<unsigned int, 2>> &local)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        to.insert(to.end(), local.begin(), local.end());
+    };
+
+    // vertex-triangle: a vertex close to a triangle lies in its grown box, hence in one of the cells the triangle is binned in
+    vertex_triangle_candidates.clear();
+    parallel_range_for(static_cast<size_t>(0), x.size(), [&](size_t b, size_t e)
+    {
+        std::vector<std::array<unsigned int, 2>> local;
+        for (size_t v = b; v < e; ++v)
+        {
+            Vec3 p = x.get(v);
+            auto cell = triangle_hash.cell_of(p);
+            auto bucket = triangle_hash.bucket_of(cell[0], cell[1], cell[2]);
+            unsigned int last = ~0u;
+            for (auto k = triangle_hash.bucket_start[bucket]; k < triangle_hash.bucket_start[bucket + 1]; ++k)
+            {
+                auto t = triangle_hash.items[k];
+                if (t == last) // two cells of one triangle may share a bucket, other repeats are removed after the sort
+                    continue;
+                last = t;
+                auto &tri = triangles[t];
+                auto &box = triangle_boxes[t];
+                if (tri[0] == v || tri[1] == v || tri[2] == v)
+                    continue;
+                if (p.x < box.min.x || p.y < box.min.y || p.z < box.min.z || p.x > box.max.x || p.y > box.max.y || p.z > box.max.z)
+                    continue;
+                if (inv_masses[v] + inv_masses[tri[0]] + inv_masses[tri[1]] + inv_masses[tri[2]] <= 0)
+                    continue;
+                if (rest_vertex_triangle_closer(static_cast<unsigned int>(v), t, r))
+                    continue;
+                Vec3 t0 = x.get(tri[0]), t1 = x.get(tri[1]), t2 = x.get(tri[2]);
+                Vec3 bary = closest_point_on_triangle(p, t0, t1, t2);
+                if ((p - (bary.x * t0 + bary.y * t1 + bary.z * t2)).norm_squared() >= r * r)
+                    continue;
+                local.push_back({static_cast<unsigned int>(v), t});
+            }
+        }
+        merge(vertex_triangle_candidates, local);
+    });
+
+    // edge-edge: all pairs sharing a bucket, a pair is kept only in the bucket of the cell holding the lower corner of
+    // the overlap of both boxes, so no other bucket reports it; an edge whose cells share that bucket is listed there
+    // more than once though, the repeats are removed after the sort
+    edge_edge_candidates.clear();
+    parallel_range_for(static_cast<size_t>(0), edge_hash.bucket_start.size() - 1, [&](size_t b, size_t e)
+    {
+        std::vector<std::array<unsigned int, 2>> local;
+        for (size_t bucket = b; bucket < e; ++bucket)
+            for (auto k = edge_hash.bucket_start[bucket]; k < edge_hash.bucket_start[bucket + 1]; ++k)
+            {
+                auto i = edge_hash.items[k];
+                auto &box = edge_boxes[i];
+                auto a0 = edges[i][0], a1 = edges[i][1];
+                for (auto l = k + 1; l < edge_hash.bucket_start[bucket + 1]; ++l)
+                {
+                    auto j = edge_hash.items[l];
+                    if (i == j || !overlaps(box, edge_boxes[j]))
+                        continue;
+                    auto b0 = edges[j][0], b1 = edges[j][1];
+                    if (a0 == b0 || a0 == b1 || a1 == b0 || a1 == b1)
+                        continue;
+                    auto &ci = edge_hash.first_cells[i], &cj = edge_hash.first_cells[j]; // floor is monotonic, this is the cell of the corner
+                    if (edge_hash.bucket_of(std::max(ci[0], cj[0]), std::max(ci[1], cj[1]), std::max(ci[2], cj[2])) != bucket)
+                        continue;
+                    if (inv_masses[a0] + inv_masses[a1] + inv_masses[b0] + inv_masses[b1] <= 0)
+                        continue;
+                    if (rest_edge_edge_closer(i, j, r))
+                        continue;
+                    Vec3 p0 = x.get(a0), p1 = x.get(a1), q0 = x.get(b0), q1 = x.get(b1);
+                    float s, t;
+                    closest_points_on_segments(p0, p1, q0, q1, s, t);
+                    if (((p0 + s * (p1 - p0)) - (q0 + t * (q1 - q0))).norm_squared() >= r * r)
+                        continue;
+                    local.push_back({std::min(i, j), std::max(i, j)});
+                }
+            }
+        merge(edge_edge_candidates, local);
+    });
+
+    // the merge order depends on the scheduling, the candidates should not; a pair found twice would be resolved twice
+    std::sort(vertex_triangle_candidates.begin(), vertex_triangle_candidates.end());
+    vertex_triangle_candidates.erase(std::unique(vertex_triangle_candidates.begin(), vertex_triangle_candidates.end()), vertex_triangle_candidates.end());
+    std::sort(edge_edge_candidates.begin(), edge_edge_candidates.end());
+    edge_edge_candidates.erase(std::unique(edge_edge_candidates.begin(), edge_edge_candidates.end()), edge_edge_candidates.end());
+}
+
+auto HinaPE::ClothSelfCollision::detect(const Vec3Stream &x) -> void
+{
+    HINAPE_PROFILE_ZONE("self_collision.detect");
+    const float thickness = this->thickness();
+    std::mutex mutex;
+    contacts.clear();
+    stats.candidate_pairs = vertex_triangle_candidates.size() + edge_edge_candidates.size();
+
+    auto merge = [&](const std::vector<Contact> &local, size_t &found)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        found += local.size();
+        contacts.insert(contacts.end(), local.begin(), local.end());
+    };
+
+    parallel_range_for(static_cast<size_t>(0), vertex_triangle_candidates.size(), [&](size_t b, size_t e)
+    {
+        std::vector<Contact> local;
+        for (size_t k = b; k < e; ++k)
+        {
+            auto v = vertex_triangle_candidates[k][0];
+            auto &tri = triangles[vertex_triangle_candidates[k][1]];
+            Vec3 p = x.get(v), t0 = x.get(tri[0]), t1 = x.get(tri[1]), t2 = x.get(tri[2]);
+            Vec3 bary = closest_point_on_triangle(p, t0, t1, t2);
+            Vec3 d = p - (bary.x * t0 + bary.y * t1 + bary.z * t2);
+            float distance = d.norm();
+            if (distance >= thickness)
+                continue;
+            Vec3 n = distance > 1e-7f ? d / distance : cross(t1 - t0, t2 - t0).unit();
+            local.push_back({{v, tri[0], tri[1], tri[2]}, {1.f, -bary.x, -bary.y, -bary.z}, n});
+        }
+        merge(local, stats.vertex_triangle);
+    });
+
+    parallel_range_for(static_cast<size_t>(0), edge_edge_candidates.size(), [&](size_t b, size_t e)
+    {
+        std::vector<Contact> local;
+        for (size_t k = b; k < e; ++k)
+        {
+            auto &ea = edges[edge_edge_candidates[k][0]], &eb = edges[edge_edge_candidates[k][1]];
+            Vec3 p0 = x.get(ea[0]), p1 = x.get(ea[1]), q0 = x.get(eb[0]), q1 = x.get(eb[1]);
+            float s, t;
+            closest_points_on_segments(p0, p1, q0, q1, s, t);
+            Vec3 d = (p0 + s * (p1 - p0)) - (q0 + t * (q1 - q0));
+            float distance = d.norm();
+            if (distance >= thickness)
+                continue;
+            Vec3 n;
+            if (distance > 1e-7f)
+                n = d / distance;
+            else
+            {
+                n = cross(p1 - p0, q1 - q0); // crossing edges, separate along the common normal
+                if (n.norm_squared() < 1e-14f)
+                    continue;
+                n = n.unit();
+            }
+            local.push_back({{ea[0], ea[1], eb[0], eb[1]}, {1 - s, s, t - 1, -t}, n});
+        }
+        merge(local, stats.edge_edge);
+    });
+
+    // the merge order depends on the scheduling, the resolution should not
+    std::sort(contacts.begin(), contacts.end());
+}
+
+auto HinaPE::ClothSelfCollision::build_contact_lists(size_t n) -> void
+{
+    // counting sort of the (contact, slot) entries by vertex, every vertex is then sorted so the sums of the resolution
+    // do not depend on the scheduling
+    vertex_start.assign(n + 1, 0);
+    parallel_for(static_cast<size_t>(0), contacts.size(), [&](size_t k)
+    {
+        for (int i = 0; i < 4; ++i)
+            std::atomic_ref<unsigned int>(vertex_start[contacts[k].v[i]]).fetch_add(1, std::memory_order_relaxed);
+    });
+    parallel_exclusive_scan(vertex_start.begin(), vertex_start.end(), vertex_start.begin(), 0u);
+    vertex_cursor.assign(vertex_start.begin(), vertex_start.end() - 1);
+    vertex_entries.resize(4 * contacts.size());
+    parallel_for(static_cast<size_t>(0), contacts.size(), [&](size_t k)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            auto slot = std::atomic_ref<unsigned int>(vertex_cursor[contacts[k].v[i]]).fetch_add(1, std::memory_order_relaxed);
+            vertex_entries[slot] = static_cast<unsigned int>(4 * k + i);
+        }
+    });
+    parallel_for(static_cast<size_t>(0), n, [&](size_t v)
+    {
+        if (vertex_start[v + 1] - vertex_start[v] > 1)
+            std::sort(vertex_entries.begin() + vertex_start[v], vertex_entries.begin() + vertex_start[v + 1]);
+    });
+}
+
+auto HinaPE::ClothSelfCollision::resolve(Vec3Stream &x, const std::vector<float> &inv_masses) -> void
+{
+    HINAPE_PROFILE_ZONE("self_collision.resolve");
+    if (contacts.empty())
+        return;
+    const size_t n = x.size();
+    const float thickness = this->thickness();
+    build_contact_lists(n);
+    lambdas.resize(contacts.size());
+    for (int iter = 0; iter < opt.iterations; ++iter)
+    {
+        // Jacobi: every contact computes its multiplier from the same positions ...
+        stats.resolved += parallel_reduce(static_cast<size_t>(0), contacts.size(), static_cast<size_t>(0), [&](size_t b, size_t e, size_t resolved)
+        {
+            for (size_t k = b; k < e; ++k)
+            {
+                auto &c = contacts[k];
+                Vec3 p;
+                float denominator = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    p += c.c[i] * x.get(c.v[i]);
+                    denominator += c.c[i] * c.c[i] * inv_masses[c.v[i]];
+                }
+                float C = dot(p, c.n) - thickness;
+                lambdas[k] = C < 0 && denominator > 0 ? -C / denominator : 0.f;
+                resolved += lambdas[k] != 0;
+            }
+            return resolved;
+        }, [](size_t a, size_t b) { return a + b; });
+
+        // ... then every vertex averages the corrections of its contacts
+        parallel_for(static_cast<size_t>(0), n, [&](size_t v)
+        {
+            Vec3 delta;
+            unsigned int count = 0;
+            for (auto e = vertex_start[v]; e < vertex_start[v + 1]; ++e)
+            {
+                auto k = vertex_entries[e] / 4, i = vertex_entries[e] % 4;
+                if (lambdas[k] == 0)
+                    continue;
+                delta += (inv_masses[v] * contacts[k].c[i] * lambdas[k]) * contacts[k].n;
+                ++count;
+            }
+            if (count > 0)
+                x.add(v, delta / (float) count);
+        });
+    }
+}
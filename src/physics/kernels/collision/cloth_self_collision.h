@@ -0,0 +1,103 @@
+#ifndef HINAPE_CLOTH_SELF_COLLISION_H
+#define HINAPE_CLOTH_SELF_COLLISION_H
+
+#include "../../common.h"
+#include "../../util/vec3_stream.h"
+#include "lib/bbox.h"
+
+#include <array>
+#include <utility>
+#include <vector>
+
+namespace HinaPE
+{
+// Vertex-triangle and edge-edge self-collision of one cloth, resolved by a thickness-based position correction.
+// Candidate pairs come from spatial hashes over the triangle and edge boxes, built in parallel. Boxes are grown by
+// a skin, so the candidates stay valid (and the hashes are not rebuilt) until some vertex moved more than skin / 2.
+// Pairs already closer than the candidate distance in the rest shape (the topological neighbours) are never tested.
+class ClothSelfCollision
+{
+public:
+    struct Opt
+    {
+        float thickness = 0.01f; // clamped to the shortest rest edge, see thickness()
+        float skin = 0; // extra candidate distance, 0 picks the thickness
+        float cell_size = 0; // 0 picks the mean edge length
+        int iterations = 2; // resolution passes over the detected contacts
+    };
+    Opt opt;
+
+    struct Counters
+    {
+        size_t candidate_pairs = 0; // narrow phase tests
+        size_t vertex_triangle = 0; // contacts found
+        size_t edge_edge = 0;
+        size_t resolved = 0; // contact projections that moved particles
+        size_t rebuilds = 0; // candidate rebuilds, the candidates of the previous solve are reused otherwise
+
+        auto operator+=(const Counters &other) -> Counters &;
+    };
+
+    auto set_topology(const Vec3Stream &x, const std::vector<int> &indices, const std::vector<std::pair<int, int>> &edges) -> void;
+    auto solve(Vec3Stream &x, const std::vector<float> &inv_masses) -> void; // detect, then push the contacts apart
+    auto counters() const -> const Counters &;
+    auto thickness() const -> float; // opt.thickness, clamped to the shortest rest edge
+    auto invalidate() -> void; // rebuild the candidates on the next solve, e.g. after the positions were restored
+
+private:
+    // boxes binned into every cell they overlap, bucket b holds items[bucket_start[b], bucket_start[b + 1])
+    struct SpatialHash
+    {
+        float cell = 1;
+        std::vector<unsigned int> offsets, entry_buckets, entry_items;
+        std::vector<std::array<int, 3>> first_cells; // cell of the lower corner of every box
+        std::vector<unsigned int> bucket_start, bucket_cursor, items;
+
+        auto build(const std::vector<BBox> &boxes) -> void;
+        auto cell_of(const Vec3 &p) const -> std::array<int, 3>;
+        auto bucket_of(int i, int j, int k) const -> unsigned int;
+    };
+    // constraint C = dot(sum c_i x_i, n) - thickness >= 0, vertex-triangle: (p, t0, t1, t2) with c = (1, -b0, -b1, -b2),
+    // edge-edge: (a0, a1, b0, b1) with c = (1 - s, s, t - 1, -t)
+    struct Contact
+    {
+        std::array<unsigned int, 4> v{};
+        std::array<float, 4> c{};
+        Vec3 n;
+        auto operator<(const Contact &other) const -> bool { return v != other.v ? v < other.v : c < other.c; } // a vertex-triangle and an edge-edge contact may share v
+    };
+
+    auto needs_rebuild(const Vec3Stream &x) const -> bool;
+    auto build_candidates(const Vec3Stream &x, const std::vector<float> &inv_masses) -> void;
+    auto rest_vertex_triangle_closer(unsigned int v, unsigned int t, float r) const -> bool;
+    auto rest_edge_edge_closer(unsigned int i, unsigned int j, float r) const -> bool;
+    auto detect(const Vec3Stream &x) -> void;
+    auto build_contact_lists(size_t n) -> void;
+    auto resolve(Vec3Stream &x, const std::vector<float> &inv_masses) -> void;
+
+    // topology
+    std::vector<std::array<unsigned int, 3>> triangles;
+    std::vector<std::array<unsigned int, 2>> edges;
+    Vec3Stream rest;
+    std::vector<Vec3> triangle_rest_centres, edge_rest_centres; // with the radius of a sphere around the element, they
+    std::vector<float> triangle_rest_radii, edge_rest_radii;    // settle most rest distance tests without closest points
+    float mean_edge_length = 0;
+    float min_edge_length = 0;
+
+    // broad phase, rebuilt when the positions drifted too far from the reference
+    SpatialHash triangle_hash, edge_hash;
+    std::vector<BBox> triangle_boxes, edge_boxes;
+    std::vector<std::array<unsigned int, 2>> vertex_triangle_candidates, edge_edge_candidates;
+    Vec3Stream reference;
+    bool built = false;
+
+    // contacts, and per vertex the (contact, slot) entries 4 * k + i touching it, vertex v holds
+    // vertex_entries[vertex_start[v], vertex_start[v + 1])
+    std::vector<Contact> contacts;
+    std::vector<float> lambdas;
+    std::vector<unsigned int> vertex_start, vertex_cursor, vertex_entries;
+    Counters stats;
+};
+}
+
+#endif //HINAPE_CLOTH_SELF_COLLISION_H
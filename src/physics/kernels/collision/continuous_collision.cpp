@@ -0,0 +1,387 @@
+#include "continuous_collision.h"
+#include "proximity.h"
+#include "../../physics_system.h"
+#include "../../util/parallel_lib/parallel_for.h"
+#include "../../util/profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace
+{
+struct Vec3d
+{
+    double x = 0, y = 0, z = 0;
+    explicit Vec3d(const Vec3 &v) : x(v.x), y(v.y), z(v.z) {}
+    Vec3d(double x, double y, double z) : x(x), y(y), z(z) {}
+    auto operator-(const Vec3d &o) const -> Vec3d { return {x - o.x, y - o.y, z - o.z}; }
+};
+auto dot(const Vec3d &a, const Vec3d &b) -> double { return a.x * b.x + a.y * b.y + a.z * b.z; }
+auto cross(const Vec3d &a, const Vec3d &b) -> Vec3d { return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; }
+
+// roots of c3 t^3 + c2 t^2 + c1 t + c0 in [0, 1], ascending
+auto cubic_roots(double c3, double c2, double c1, double c0, std::array<double, 3> &roots) -> int
+{
+    auto f = [&](double t) { return ((c3 * t + c2) * t + c1) * t + c0; };
+
+    // split [0, 1] at the extrema, the cubic is monotone on every piece
+    std::array<double, 2> extrema{};
+    int m = 0;
+    double a = 3 * c3, b = 2 * c2, c = c1;
+    if (std::abs(a) > 1e-300)
+    {
+        double discriminant = b * b - 4 * a * c;
+        if (discriminant > 0)
+        {
+            double q = -0.5 * (b + std::copysign(std::sqrt(discriminant), b));
+            extrema[m++] = q / a;
+            if (q != 0)
+                extrema[m++] = c / q;
+        }
+    } else if (std::abs(b) > 1e-300)
+        extrema[m++] = -c / b;
+    std::sort(extrema.begin(), extrema.begin() + m);
+    std::array<double, 4> knots{0.0};
+    int n = 1;
+    for (int k = 0; k < m; ++k)
+        if (extrema[k] > 0 && extrema[k] < 1)
+            knots[n++] = extrema[k];
+    knots[n++] = 1;
+
+    // at most one root per piece, found by bisection
+    int count = 0;
+    for (int k = 0; k + 1 < n; ++k)
+    {
+        double lo = knots[k], hi = knots[k + 1], f_lo = f(lo), f_hi = f(hi);
+        if (f_lo == 0)
+            roots[count++] = lo;
+        else if (f_hi == 0 && k + 2 == n)
+            roots[count++] = hi;
+        else if ((f_lo < 0) != (f_hi < 0))
+        {
+            for (int it = 0; it < 48; ++it)
+            {
+                double mid = 0.5 * (lo + hi), f_mid = f(mid);
+                if ((f_mid < 0) == (f_lo < 0))
+                    lo = mid, f_lo = f_mid;
+                else
+                    hi = mid;
+            }
+            roots[count++] = 0.5 * (lo + hi);
+        }
+    }
+    return count;
+}
+
+// times in [0, 1] at which p0..p3, moving linearly from x0 to x1, are coplanar: det[p1 - p0, p2 - p0, p3 - p0](t) = 0
+auto coplanarity_times(const std::array<Vec3, 4> &x0, const std::array<Vec3, 4> &x1, std::array<double, 3> &roots) -> int
+{
+    std::array<Vec3d, 3> a{Vec3d(x0[1]) - Vec3d(x0[0]), Vec3d(x0[2]) - Vec3d(x0[0]), Vec3d(x0[3]) - Vec3d(x0[0])};
+    std::array<Vec3d, 3> b{Vec3d(x1[1] - x0[1]) - Vec3d(x1[0] - x0[0]), Vec3d(x1[2] - x0[2]) - Vec3d(x1[0] - x0[0]), Vec3d(x1[3] - x0[3]) - Vec3d(x1[0] - x0[0])};
+    auto aa = cross(a[0], a[1]), ab = cross(a[0], b[1]), ba = cross(b[0], a[1]), bb = cross(b[0], b[1]);
+    double c3 = dot(bb, b[2]);
+    double c2 = dot(bb, a[2]) + dot(ab, b[2]) + dot(ba, b[2]);
+    double c1 = dot(aa, b[2]) + dot(ab, a[2]) + dot(ba, a[2]);
+    double c0 = dot(aa, a[2]);
+    return cubic_roots(c3, c2, c1, c0, roots);
+}
+
+auto lerp(const Vec3 &a, const Vec3 &b, float t) -> Vec3 { return a + t * (b - a); }
+
+// first time the point 0 comes within eps of the triangle (1, 2, 3), > 1 if it does not
+auto vertex_triangle_toi(const std::array<Vec3, 4> &x0, const std::array<Vec3, 4> &x1, float eps) -> float
+{
+    std::array<double, 3> roots{};
+    int n = coplanarity_times(x0, x1, roots);
+    for (int k = 0; k < n; ++k)
+    {
+        auto t = static_cast<float>(roots[k]);
+        Vec3 p = lerp(x0[0], x1[0], t), a = lerp(x0[1], x1[1], t), b = lerp(x0[2], x1[2], t), c = lerp(x0[3], x1[3], t);
+        Vec3 bary = HinaPE::closest_point_on_triangle(p, a, b, c);
+        Vec3 d = p - (bary.x * a + bary.y * b + bary.z * c);
+        if (d.norm_squared() > eps * eps)
+            continue;
+        // a pair resting within eps at the start is only an impact if it still closes in
+        Vec3 v = (x1[0] - x0[0]) - (bary.x * (x1[1] - x0[1]) + bary.y * (x1[2] - x0[2]) + bary.z * (x1[3] - x0[3]));
+        if (roots[k] == 0 && d.norm_squared() > 0 && dot(d, v) >= 0)
+            continue;
+        return t;
+    }
+    return 2;
+}
+
+// first time the edge (0, 1) comes within eps of the edge (2, 3), > 1 if it does not
+auto edge_edge_toi(const std::array<Vec3, 4> &x0, const std::array<Vec3, 4> &x1, float eps) -> float
+{
+    std::array<double, 3> roots{};
+    int n = coplanarity_times(x0, x1, roots);
+    for (int k = 0; k < n; ++k)
+    {
+        auto t = static_cast<float>(roots[k]);
+        Vec3 p0 = lerp(x0[0], x1[0], t), p1 = lerp(x0[1], x1[1], t), q0 = lerp(x0[2], x1[2], t), q1 = lerp(x0[3], x1[3], t);
+        float s, u;
+        HinaPE::closest_points_on_segments(p0, p1, q0, q1, s, u);
+        Vec3 d = (p0 + s * (p1 - p0)) - (q0 + u * (q1 - q0));
+        if (d.norm_squared() > eps * eps)
+            continue;
+        Vec3 v = lerp(x1[0] - x0[0], x1[1] - x0[1], s) - lerp(x1[2] - x0[2], x1[3] - x0[3], u);
+        if (roots[k] == 0 && d.norm_squared() > 0 && dot(d, v) >= 0)
+            continue;
+        return t;
+    }
+    return 2;
+}
+
+auto swept_box(std::initializer_list<Vec3> points, float margin) -> BBox
+{
+    BBox box;
+    for (auto &p: points)
+        box.enclose(p);
+    return BBox(box.min - Vec3(margin), box.max + Vec3(margin));
+}
+}
+
+HinaPE::ContinuousCollision::ContinuousCollision(PhysicsSystem &sys) : physics_system(sys) {}
+
+auto HinaPE::ContinuousCollision::set_collider(unsigned int ID, std::vector<Vec3> _vertices, std::vector<int> _indices) -> void
+{
+    std::lock_guard<std::mutex> lock(collider_mutex);
+    colliders[ID] = Collider{std::move(_vertices), std::move(_indices), next_version++};
+}
+
+auto HinaPE::ContinuousCollision::remove_collider(unsigned int ID) -> void
+{
+    std::lock_guard<std::mutex> lock(collider_mutex);
+    colliders.erase(ID);
+}
+
+auto HinaPE::ContinuousCollision::clear_colliders() -> void
+{
+    std::lock_guard<std::mutex> lock(collider_mutex);
+    colliders.clear();
+}
+
+auto HinaPE::ContinuousCollision::counters() const -> const Counters &
+{
+    return stats;
+}
+
+auto HinaPE::ContinuousCollision::update() -> void
+{
+    HINAPE_PROFILE_ZONE("ccd.update");
+    stats = {};
+    std::lock_guard<std::mutex> lock(collider_mutex);
+    std::vector<Placement> current;
+    for (auto &e: physics_system.objects<RigidBodyBase<STATIC>>())
+    {
+        auto it = colliders.find(e.id);
+        if (it != colliders.end())
+            current.push_back({e.id, it->second.version, e.body->get_position(), e.body->get_rotation()});
+    }
+    std::sort(current.begin(), current.end(), [](const Placement &a, const Placement &b) { return a.id < b.id; });
+    if (current != placements)
+        rebuild(current);
+    stats.colliders = placements.size();
+    stats.triangles = triangles.size();
+}
+
+auto HinaPE::ContinuousCollision::rebuild(const std::vector<Placement> &_placements) -> void
+{
+    HINAPE_PROFILE_ZONE("ccd.rebuild");
+    placements = _placements;
+    vertices.clear();
+    triangles.clear();
+    edges.clear();
+    for (auto &p: placements)
+    {
+        auto &collider = colliders.at(p.id);
+        Mat4 transform = Mat4::translate(p.position) * Mat4::euler(p.rotation);
+        auto offset = static_cast<unsigned int>(vertices.size());
+        for (auto &v: collider.vertices)
+            vertices.push_back(transform * v);
+        for (size_t k = 0; k + 2 < collider.indices.size(); k += 3)
+        {
+            std::array<unsigned int, 3> tri{offset + collider.indices[k], offset + collider.indices[k + 1], offset + collider.indices[k + 2]};
+            triangles.push_back(tri);
+            for (int e = 0; e < 3; ++e)
+                edges.push_back({std::min(tri[e], tri[(e + 1) % 3]), std::max(tri[e], tri[(e + 1) % 3])});
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    std::vector<BBox> boxes(triangles.size());
+    for (size_t t = 0; t < triangles.size(); ++t)
+        boxes[t] = swept_box({vertices[triangles[t][0]], vertices[triangles[t][1]], vertices[triangles[t][2]]}, 0);
+    triangle_tree.build(boxes);
+    boxes.resize(edges.size());
+    for (size_t e = 0; e < edges.size(); ++e)
+        boxes[e] = swept_box({vertices[edges[e][0]], vertices[edges[e][1]]}, 0);
+    edge_tree.build(boxes);
+}
+
+auto HinaPE::ContinuousCollision::solve(const Vec3Stream &start, Vec3Stream &end, const std::vector<float> &inv_masses, const std::vector<std::pair<int, int>> &_edges) -> void
+{
+    HINAPE_PROFILE_ZONE("ccd.solve");
+    if (triangle_tree.empty() || end.empty())
+        return;
+    // a correction may lead into another collider, sweep again until nothing is hit
+    size_t hits = 1;
+    for (int pass = 0; pass < opt.iterations && hits > 0; ++pass)
+        hits = sweep_vertices(start, end, inv_masses, false) + sweep_edges(start, end, inv_masses, _edges, false);
+
+    // then fall back to the start positions, which were free of impacts; moving a particle back changes the motion of
+    // its edges, so this repeats until no edge is hit either
+    for (int pass = 0; pass < opt.iterations && hits > 0; ++pass)
+        hits = sweep_vertices(start, end, inv_masses, true) + sweep_edges(start, end, inv_masses, _edges, true);
+
+    // still hitting: every free particle goes back to its start
+    if (hits > 0)
+        for (size_t i = 0; i < end.size(); ++i)
+            if (inv_masses[i] > 0 && end.get(i) != start.get(i))
+            {
+                end.set(i, start.get(i));
+                ++stats.reverted;
+            }
+}
+
+auto HinaPE::ContinuousCollision::sweep_vertices(const Vec3Stream &start, Vec3Stream &end, const std::vector<float> &inv_masses, bool revert) -> size_t
+{
+    const float thickness = opt.thickness;
+    std::atomic<size_t> hits = 0;
+    parallel_range_for(static_cast<size_t>(0), end.size(), [&](size_t b, size_t e)
+    {
+        size_t boxes = 0, tests = 0, found = 0, reverted = 0;
+        for (size_t i = b; i < e; ++i)
+        {
+            if (inv_masses[i] <= 0)
+                continue;
+            Vec3 x0 = start.get(i), x1 = end.get(i);
+            if (x0 == x1) // resting, or already moved back
+                continue;
+            ++boxes;
+            float toi = 2;
+            unsigned int hit = 0;
+            triangle_tree.query(swept_box({x0, x1}, thickness), [&](unsigned int t)
+            {
+                auto &tri = triangles[t];
+                Vec3 a = vertices[tri[0]], b = vertices[tri[1]], c = vertices[tri[2]];
+                ++tests;
+                float t_hit = vertex_triangle_toi({x0, a, b, c}, {x1, a, b, c}, thickness);
+                if (t_hit < toi)
+                    toi = t_hit, hit = t;
+            });
+            if (toi > 1)
+                continue;
+            ++found;
+            if (revert)
+            {
+                end.set(i, x0);
+                ++reverted;
+                continue;
+            }
+
+            // back onto the side it came from, the tangential part of the motion is kept
+            auto &tri = triangles[hit];
+            Vec3 a = vertices[tri[0]];
+            Vec3 n = cross(vertices[tri[1]] - a, vertices[tri[2]] - a).unit();
+            float from = dot(x0 - a, n);
+            float side = std::abs(from) > 1e-9f ? (from > 0 ? 1.f : -1.f) : (dot(x1 - x0, n) > 0 ? -1.f : 1.f);
+            float to = dot(x1 - a, n);
+            if (side * to < thickness)
+                end.set(i, x1 + (side * thickness - to) * n);
+        }
+        std::atomic_ref<size_t>(stats.swept_boxes).fetch_add(boxes, std::memory_order_relaxed);
+        std::atomic_ref<size_t>(stats.vertex_triangle_tests).fetch_add(tests, std::memory_order_relaxed);
+        std::atomic_ref<size_t>(stats.vertex_triangle).fetch_add(found, std::memory_order_relaxed);
+        std::atomic_ref<size_t>(stats.reverted).fetch_add(reverted, std::memory_order_relaxed);
+        hits += found;
+    });
+    return hits;
+}
+
+auto HinaPE::ContinuousCollision::sweep_edges(const Vec3Stream &start, Vec3Stream &end, const std::vector<float> &inv_masses, const std::vector<std::pair<int, int>> &_edges, bool revert) -> size_t
+{
+    const float thickness = opt.thickness;
+    edge_impacts.assign(_edges.size(), Impact());
+    parallel_range_for(static_cast<size_t>(0), _edges.size(), [&](size_t b, size_t e)
+    {
+        size_t boxes = 0, tests = 0;
+        for (size_t k = b; k < e; ++k)
+        {
+            auto i = _edges[k].first, j = _edges[k].second;
+            if (inv_masses[i] + inv_masses[j] <= 0)
+                continue;
+            Vec3 p0 = start.get(i), p1 = start.get(j), q0 = end.get(i), q1 = end.get(j);
+            if (p0 == q0 && p1 == q1)
+                continue;
+            ++boxes;
+            auto &impact = edge_impacts[k];
+            unsigned int hit = 0;
+            edge_tree.query(swept_box({p0, p1, q0, q1}, thickness), [&](unsigned int s)
+            {
+                Vec3 a = vertices[edges[s][0]], c = vertices[edges[s][1]];
+                ++tests;
+                float t_hit = edge_edge_toi({p0, p1, a, c}, {q0, q1, a, c}, thickness);
+                if (t_hit < impact.toi)
+                    impact.toi = t_hit, hit = s;
+            });
+            if (impact.toi > 1 || revert)
+                continue;
+
+            // separate along the common normal at the impact, towards the side the edge came from
+            Vec3 a = vertices[edges[hit][0]], c = vertices[edges[hit][1]];
+            float s, t;
+            Vec3 n = cross(lerp(p1, q1, impact.toi) - lerp(p0, q0, impact.toi), c - a);
+            closest_points_on_segments(p0, p1, a, c, s, t);
+            Vec3 from = (p0 + s * (p1 - p0)) - (a + t * (c - a));
+            if (n.norm_squared() < 1e-12f) // parallel edges
+                n = from;
+            if (n.norm_squared() < 1e-12f)
+                continue;
+            n = n.unit();
+            float side = dot(from, n) >= 0 ? 1.f : -1.f;
+            closest_points_on_segments(q0, q1, a, c, s, t);
+            float to = dot((q0 + s * (q1 - q0)) - (a + t * (c - a)), n);
+            if (side * to < thickness)
+                impact.correction = (side * thickness - to) * n;
+        }
+        std::atomic_ref<size_t>(stats.swept_boxes).fetch_add(boxes, std::memory_order_relaxed);
+        std::atomic_ref<size_t>(stats.edge_edge_tests).fetch_add(tests, std::memory_order_relaxed);
+    });
+
+    // edges share particles, their corrections are averaged
+    size_t hits = 0;
+    deltas.assign(end.size(), Vec3());
+    delta_counts.assign(end.size(), 0);
+    for (size_t k = 0; k < _edges.size(); ++k)
+    {
+        if (edge_impacts[k].toi > 1)
+            continue;
+        ++hits;
+        for (int i: {_edges[k].first, _edges[k].second})
+        {
+            if (inv_masses[i] <= 0)
+                continue;
+            if (revert)
+            {
+                if (delta_counts[i] == 0)
+                    ++stats.reverted;
+                end.set(i, start.get(i));
+                delta_counts[i] = 1;
+                continue;
+            }
+            deltas[i] += edge_impacts[k].correction;
+            ++delta_counts[i];
+        }
+    }
+    stats.edge_edge += hits;
+    if (!revert && hits > 0)
+        parallel_for(static_cast<size_t>(0), end.size(), [&](size_t i)
+        {
+            if (delta_counts[i] > 0)
+                end.add(i, deltas[i] / (float) delta_counts[i]);
+        });
+    return hits;
+}
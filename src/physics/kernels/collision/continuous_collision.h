@@ -0,0 +1,98 @@
+#ifndef HINAPE_CONTINUOUS_COLLISION_H
+#define HINAPE_CONTINUOUS_COLLISION_H
+
+#include "../../common.h"
+#include "../../util/vec3_stream.h"
+#include "static_bvh.h"
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace HinaPE
+{
+class PhysicsSystem;
+
+// Continuous collision of deformables against static rigid bodies.
+// The triangles and edges of every static collider are kept in two BVHs. Each particle (and each edge) is swept from
+// its start to its end position, the swept boxes pick the candidates and the exact time of impact is the first root
+// of the cubic coplanarity condition. Hit particles are pushed back to the side they came from.
+class ContinuousCollision
+{
+public:
+    struct Opt
+    {
+        float thickness = 1e-3f; // distance kept to the collider surface
+        int iterations = 3; // sweep passes, then as many passes moving the hit particles back to their start, then all moved particles go back
+    };
+    Opt opt;
+
+    struct Counters
+    {
+        size_t colliders = 0; // static bodies with a shape
+        size_t triangles = 0;
+        size_t swept_boxes = 0; // particle and edge sweeps queried against the trees
+        size_t vertex_triangle_tests = 0; // cubic solves
+        size_t edge_edge_tests = 0;
+        size_t vertex_triangle = 0; // impacts found
+        size_t edge_edge = 0;
+        size_t reverted = 0; // particles moved back to their start position
+    };
+
+    auto set_collider(unsigned int ID, std::vector<Vec3> vertices, std::vector<int> indices) -> void; // shape of a rigid body in its local frame
+    auto remove_collider(unsigned int ID) -> void;
+    auto clear_colliders() -> void;
+    auto update() -> void; // refresh the world space colliders from the static bodies, once per step
+    auto solve(const Vec3Stream &start, Vec3Stream &end, const std::vector<float> &inv_masses, const std::vector<std::pair<int, int>> &edges) -> void;
+    auto counters() const -> const Counters &; // summed over the solves since the last update
+
+public:
+    explicit ContinuousCollision(PhysicsSystem &sys);
+
+private:
+    struct Collider
+    {
+        std::vector<Vec3> vertices;
+        std::vector<int> indices;
+        unsigned int version = 0;
+    };
+    struct Placement // what the world space geometry was built from
+    {
+        unsigned int id;
+        unsigned int version;
+        Vec3 position, rotation;
+        auto operator==(const Placement &) const -> bool = default;
+    };
+    struct Impact
+    {
+        float toi = 2; // > 1: no impact
+        Vec3 correction;
+    };
+
+    auto rebuild(const std::vector<Placement> &placements) -> void;
+    auto sweep_vertices(const Vec3Stream &start, Vec3Stream &end, const std::vector<float> &inv_masses, bool revert) -> size_t;
+    auto sweep_edges(const Vec3Stream &start, Vec3Stream &end, const std::vector<float> &inv_masses, const std::vector<std::pair<int, int>> &edges, bool revert) -> size_t;
+
+    PhysicsSystem &physics_system;
+    std::mutex collider_mutex; // colliders are set from the scene, while the simulation thread may be running
+    std::map<unsigned int, Collider> colliders;
+    unsigned int next_version = 1;
+
+    // world space geometry of the static colliders
+    std::vector<Placement> placements;
+    std::vector<Vec3> vertices;
+    std::vector<std::array<unsigned int, 3>> triangles;
+    std::vector<std::array<unsigned int, 2>> edges;
+    StaticBVH triangle_tree, edge_tree;
+
+    // scratch of the edge sweep
+    std::vector<Impact> edge_impacts;
+    std::vector<Vec3> deltas;
+    std::vector<unsigned int> delta_counts;
+    Counters stats;
+};
+}
+
+#endif //HINAPE_CONTINUOUS_COLLISION_H
@@ -0,0 +1,94 @@
+#ifndef HINAPE_PROXIMITY_H
+#define HINAPE_PROXIMITY_H
+
+#include "../../common.h"
+
+#include <algorithm>
+
+namespace HinaPE
+{
+// closest point to p on triangle (a, b, c), returned as barycentric weights (Ericson, Real-Time Collision Detection 5.1.5)
+inline auto closest_point_on_triangle(const Vec3 &p, const Vec3 &a, const Vec3 &b, const Vec3 &c) -> Vec3
+{
+    Vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = dot(ab, ap), d2 = dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0)
+        return Vec3(1.f, 0.f, 0.f);
+
+    Vec3 bp = p - b;
+    float d3 = dot(ab, bp), d4 = dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3)
+        return Vec3(0.f, 1.f, 0.f);
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+    {
+        float v = d1 / (d1 - d3);
+        return Vec3(1 - v, v, 0.f);
+    }
+
+    Vec3 cp = p - c;
+    float d5 = dot(ab, cp), d6 = dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6)
+        return Vec3(0.f, 0.f, 1.f);
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+    {
+        float w = d2 / (d2 - d6);
+        return Vec3(1 - w, 0.f, w);
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+    {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        return Vec3(0.f, 1 - w, w);
+    }
+
+    float denominator = 1.f / (va + vb + vc);
+    float v = vb * denominator, w = vc * denominator;
+    return Vec3(1 - v - w, v, w);
+}
+
+// parameters (s, t) of the closest points p0 + s (p1 - p0) and q0 + t (q1 - q0) of two segments (Ericson 5.1.9)
+inline auto closest_points_on_segments(const Vec3 &p0, const Vec3 &p1, const Vec3 &q0, const Vec3 &q1, float &s, float &t) -> void
+{
+    constexpr float epsilon = 1e-12f;
+    Vec3 d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+    float a = dot(d1, d1), e = dot(d2, d2), f = dot(d2, r);
+    if (a <= epsilon && e <= epsilon)
+    {
+        s = t = 0;
+        return;
+    }
+    if (a <= epsilon)
+    {
+        s = 0;
+        t = std::clamp(f / e, 0.f, 1.f);
+        return;
+    }
+    float c = dot(d1, r);
+    if (e <= epsilon)
+    {
+        t = 0;
+        s = std::clamp(-c / a, 0.f, 1.f);
+        return;
+    }
+    float b = dot(d1, d2);
+    float denominator = a * e - b * b;
+    s = denominator > epsilon ? std::clamp((b * f - c * e) / denominator, 0.f, 1.f) : 0.f; // parallel segments: any s works
+    t = (b * s + f) / e;
+    if (t < 0)
+    {
+        t = 0;
+        s = std::clamp(-c / a, 0.f, 1.f);
+    } else if (t > 1)
+    {
+        t = 1;
+        s = std::clamp((b - c) / a, 0.f, 1.f);
+    }
+}
+}
+
+#endif //HINAPE_PROXIMITY_H
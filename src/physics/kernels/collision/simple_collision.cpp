@@ -1 +1,171 @@
 #include "simple_collision.h"
+#include "../../physics_system.h"
+#include "../../util/profiler.h"
+
+#include <algorithm>
+
+namespace
+{
+auto bounds(HinaPE::PhysicsObject &o) -> BBox
+{
+    BBox box;
+    if (o.is<HinaPE::DeformableBase<HinaPE::CLOTH>>() || o.is<HinaPE::DeformableBase<HinaPE::MESH>>())
+    {
+        auto &v = o.get_vertices();
+        for (size_t i = 0; i < v.size(); ++i)
+            box.enclose(v.get(i));
+    }
+    else
+        box.enclose(o.get_position()); // rigid bodies carry no shape yet, the fat margin stands in for their extent
+    return box;
+}
+}
+
+HinaPE::SimpleCollision::SimpleCollision(HinaPE::PhysicsSystem &sys) : physics_system(sys) {}
+
+auto HinaPE::SimpleCollision::update() -> void
+{
+    HINAPE_PROFILE_ZONE("collision.broadphase");
+    if (built_for != opt.method || tree.opt.fat_margin != opt.fat_margin)
+        rebuild();
+
+    stats = {};
+    moved.clear();
+    if (++touch_stamp == 0) // wrapped, the old stamps would read as touched
+    {
+        std::fill(touch_stamps.begin(), touch_stamps.end(), 0);
+        touch_stamp = 1;
+    }
+    // drop proxies of erased objects
+    for (auto it = proxies.begin(); it != proxies.end();)
+    {
+        if (physics_system.contains(it->first))
+        {
+            ++it;
+            continue;
+        }
+        if (opt.method == Method::AABBTree)
+        {
+            touch(it->second.proxy);
+            tree.destroy_proxy(it->second.proxy);
+        } else
+            sap.destroy_proxy(it->second.proxy);
+        it = proxies.erase(it);
+    }
+
+    // create or move proxies
+    physics_system.for_each_object([&](unsigned int id, PhysicsObject &o)
+    {
+        BBox box = bounds(o);
+        if (box.empty())
+            return;
+        BBox margin_box(box.min - Vec3(opt.fat_margin), box.max + Vec3(opt.fat_margin)); // sweep and prune has no fat boxes of its own
+        bool is_static = o.is<RigidBodyBase<STATIC>>() || (o.is<RigidBodyBase<DYNAMIC>>() && o.get_object<RigidBodyBase<DYNAMIC>>().is_sleeping()); // sleeping bodies do not move either
+        auto it = proxies.find(id);
+        if (it == proxies.end())
+        {
+            int proxy = opt.method == Method::AABBTree ? tree.create_proxy(box, id, is_static) : sap.create_proxy(margin_box, id, is_static);
+            proxies.emplace(id, Proxy{proxy, box.center()});
+            if (opt.method == Method::AABBTree)
+            {
+                touch(proxy);
+                moved.push_back(proxy);
+            }
+            return;
+        }
+        auto &p = it->second;
+        if (opt.method == Method::AABBTree)
+        {
+            bool reinserted = tree.move_proxy(p.proxy, box, box.center() - p.center);
+            stats.reinserted += reinserted;
+            if (tree.set_static(p.proxy, is_static) || reinserted) // a woken body pairs with the static ones again
+            {
+                touch(p.proxy);
+                moved.push_back(p.proxy);
+            }
+        } else
+        {
+            sap.set_static(p.proxy, is_static);
+            sap.move_proxy(p.proxy, margin_box);
+        }
+        p.center = box.center();
+    });
+
+    // collect pairs, static (and sleeping) objects never pair with each other
+    found.clear();
+    if (opt.method == Method::AABBTree)
+    {
+        std::erase_if(tree_pairs, [&](const auto &pair) { return touched(pair.first) || touched(pair.second); });
+        for (int proxy: moved)
+        {
+            const bool is_static = tree.is_static(proxy);
+            stats.pairs_tested += tree.query(tree.fat_box(proxy), [&](int other)
+            {
+                if (other == proxy || (is_static && tree.is_static(other)))
+                    return;
+                if (touched(other) && other < proxy) // both were queried, report the pair once
+                    return;
+                tree_pairs.emplace_back(std::min(proxy, other), std::max(proxy, other));
+            });
+        }
+        stats.queried = moved.size();
+
+        found.reserve(tree_pairs.size());
+        for (auto &[a, b]: tree_pairs)
+        {
+            auto ia = tree.user_data(a), ib = tree.user_data(b);
+            found.emplace_back(std::min(ia, ib), std::max(ia, ib));
+        }
+    } else
+    {
+        stats.pairs_tested = sap.find_pairs([&](unsigned int a, unsigned int b) { found.emplace_back(std::min(a, b), std::max(a, b)); });
+    }
+    std::sort(found.begin(), found.end());
+    stats.proxies = proxies.size();
+    stats.pairs_found = found.size();
+    stale = false;
+}
+
+auto HinaPE::SimpleCollision::mark_stale() -> void
+{
+    stale = true;
+}
+
+auto HinaPE::SimpleCollision::update_if_stale() -> void
+{
+    if (stale)
+        update();
+}
+
+auto HinaPE::SimpleCollision::pairs() const -> const std::vector<Pair> &
+{
+    return found;
+}
+
+auto HinaPE::SimpleCollision::counters() const -> const Counters &
+{
+    return stats;
+}
+
+auto HinaPE::SimpleCollision::rebuild() -> void
+{
+    tree.clear();
+    sap.clear();
+    proxies.clear();
+    tree_pairs.clear();
+    touch_stamps.clear();
+    tree.opt.fat_margin = opt.fat_margin;
+    built_for = opt.method;
+}
+
+auto HinaPE::SimpleCollision::touch(int proxy) -> void
+{
+    if (static_cast<size_t>(proxy) >= touch_stamps.size())
+        touch_stamps.resize(proxy + 1, 0);
+    touch_stamps[proxy] = touch_stamp;
+}
+
+auto HinaPE::SimpleCollision::touched(int proxy) const -> bool
+{
+    return static_cast<size_t>(proxy) < touch_stamps.size() && touch_stamps[proxy] == touch_stamp;
+}
@@ -1,11 +1,77 @@
 #ifndef HINAPE_SIMPLE_COLLISION_H
 #define HINAPE_SIMPLE_COLLISION_H
 
+#include "aabb_tree.h"
+#include "sweep_and_prune.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
 namespace HinaPE
 {
+class PhysicsSystem;
+
+// Broadphase over all physics objects: keeps one proxy per object and reports the overlapping pairs.
+// With the tree, pairs persist between updates: only the proxies created, re-inserted or switched between static and
+// dynamic since the last update are queried, the pairs of the others still hold since their fat boxes did not change.
 class SimpleCollision
 {
+public:
+    auto update() -> void;
+    auto mark_stale() -> void; // the objects may have moved since the last update
+    auto update_if_stale() -> void; // update unless it already ran since the last mark_stale, e.g. in an earlier stage of the same tick
+
+    enum class Method
+    {
+        AABBTree, // incremental dynamic tree, best when many objects move
+        SweepAndPrune // coherent sort-and-sweep, best when most geometry is static
+    };
+    struct Opt
+    {
+        Method method = Method::AABBTree;
+        float fat_margin = 0.1f;
+    };
+    Opt opt;
+
+    struct Counters
+    {
+        size_t proxies = 0;
+        size_t pairs_tested = 0; // box overlap tests of the last update
+        size_t queried = 0; // tree proxies queried, the pairs of the others are kept
+        size_t pairs_found = 0;
+        size_t reinserted = 0; // tree proxies whose tight box escaped their fat box
+    };
+    using Pair = std::pair<unsigned int, unsigned int>; // object ids, first < second
+
+    auto pairs() const -> const std::vector<Pair> &;
+    auto counters() const -> const Counters &;
+
+public:
+    explicit SimpleCollision(PhysicsSystem &sys);
+
+private:
+    struct Proxy
+    {
+        int proxy = -1;
+        Vec3 center;
+    };
+    auto rebuild() -> void;
+    auto touch(int proxy) -> void;
+    auto touched(int proxy) const -> bool;
 
+    PhysicsSystem &physics_system;
+    Method built_for = Method::AABBTree;
+    DynamicAABBTree tree;
+    SweepAndPrune sap;
+    std::map<unsigned int, Proxy> proxies; // object id -> proxy
+    std::vector<Pair> found;
+    std::vector<std::pair<int, int>> tree_pairs; // persistent pairs of tree proxies, first < second
+    std::vector<int> moved; // tree proxies to query this update
+    std::vector<unsigned int> touch_stamps; // by tree proxy, touch_stamp if moved or destroyed this update: its old pairs are dropped
+    unsigned int touch_stamp = 0;
+    bool stale = true;
+    Counters stats;
 };
 }
 
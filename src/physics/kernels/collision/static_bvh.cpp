@@ -0,0 +1,70 @@
+#include "static_bvh.h"
+#include "../../util/profiler.h"
+
+#include <algorithm>
+#include <numeric>
+
+auto HinaPE::StaticBVH::build(const std::vector<BBox> &boxes) -> void
+{
+    HINAPE_PROFILE_ZONE("static_bvh.build");
+    clear();
+    if (boxes.empty())
+        return;
+    item_boxes = boxes;
+    items.resize(boxes.size());
+    std::iota(items.begin(), items.end(), 0u);
+    nodes.reserve(2 * boxes.size() / std::max(opt.leaf_size, 1u) + 1);
+    nodes.emplace_back();
+    split(0, 0, static_cast<unsigned int>(items.size()));
+}
+
+auto HinaPE::StaticBVH::clear() -> void
+{
+    nodes.clear();
+    items.clear();
+    item_boxes.clear();
+}
+
+auto HinaPE::StaticBVH::empty() const -> bool
+{
+    return nodes.empty();
+}
+
+auto HinaPE::StaticBVH::bounds() const -> BBox
+{
+    return nodes.empty() ? BBox() : nodes[0].box;
+}
+
+auto HinaPE::StaticBVH::split(unsigned int node, unsigned int begin, unsigned int end) -> void
+{
+    BBox box, centers;
+    for (unsigned int k = begin; k < end; ++k)
+    {
+        box.enclose(item_boxes[items[k]]);
+        centers.enclose(item_boxes[items[k]].center());
+    }
+    nodes[node].box = box;
+    if (end - begin <= std::max(opt.leaf_size, 1u))
+    {
+        nodes[node].first = begin;
+        nodes[node].count = end - begin;
+        return;
+    }
+
+    // median of the centers along the axis they spread the most
+    Vec3 extent = centers.max - centers.min;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    unsigned int mid = begin + (end - begin) / 2;
+    std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end, [&](unsigned int a, unsigned int b)
+    {
+        return item_boxes[a].center()[axis] < item_boxes[b].center()[axis];
+    });
+
+    auto left = static_cast<unsigned int>(nodes.size());
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[node].first = left;
+    nodes[node].count = 0;
+    split(left, begin, mid);
+    split(left + 1, mid, end);
+}
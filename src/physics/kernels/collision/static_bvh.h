@@ -0,0 +1,77 @@
+#ifndef HINAPE_STATIC_BVH_H
+#define HINAPE_STATIC_BVH_H
+
+#include "aabb_tree.h"
+
+#include <vector>
+
+namespace HinaPE
+{
+// Bounding volume hierarchy over a fixed set of boxes, built top-down by median splits along the longest axis.
+// Cheaper to query than the dynamic tree, but has to be rebuilt when any box changes.
+class StaticBVH
+{
+public:
+    struct Opt
+    {
+        unsigned int leaf_size = 4; // max items per leaf
+    };
+    Opt opt;
+
+    auto build(const std::vector<BBox> &boxes) -> void;
+    auto clear() -> void;
+    auto empty() const -> bool;
+    auto bounds() const -> BBox;
+
+    template<typename Callback>
+    auto query(const BBox &box, Callback &&callback) const -> size_t; // callback(item) for every item whose box overlaps, return overlap tests done
+
+private:
+    struct Node
+    {
+        BBox box;
+        unsigned int first = 0; // first item of a leaf, left child of an inner node (the right one follows it)
+        unsigned int count = 0; // 0 for inner nodes
+    };
+
+    auto split(unsigned int node, unsigned int begin, unsigned int end) -> void;
+
+    std::vector<Node> nodes;
+    std::vector<unsigned int> items;
+    std::vector<BBox> item_boxes;
+};
+
+template<typename Callback>
+auto StaticBVH::query(const BBox &box, Callback &&callback) const -> size_t
+{
+    size_t tests = 0;
+    if (nodes.empty())
+        return tests;
+    thread_local std::vector<unsigned int> stack;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+        ++tests;
+        if (!overlaps(node.box, box))
+            continue;
+        if (node.count == 0)
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+            continue;
+        }
+        for (unsigned int k = node.first; k < node.first + node.count; ++k)
+        {
+            ++tests;
+            if (overlaps(item_boxes[items[k]], box))
+                callback(items[k]);
+        }
+    }
+    return tests;
+}
+}
+
+#endif //HINAPE_STATIC_BVH_H
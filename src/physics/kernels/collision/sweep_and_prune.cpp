@@ -0,0 +1,45 @@
+#include "sweep_and_prune.h"
+
+#include <algorithm>
+
+auto HinaPE::SweepAndPrune::create_proxy(const BBox &box, unsigned int user_data, bool is_static) -> int
+{
+    int proxy;
+    if (free_proxies.empty())
+    {
+        proxy = static_cast<int>(proxies.size());
+        proxies.emplace_back();
+    } else
+    {
+        proxy = free_proxies.back();
+        free_proxies.pop_back();
+    }
+    proxies[proxy] = {box, user_data, is_static, true};
+    order.push_back(proxy); // sorted into place by the next find_pairs
+    return proxy;
+}
+
+auto HinaPE::SweepAndPrune::destroy_proxy(int proxy) -> void
+{
+    proxies[proxy].alive = false;
+    free_proxies.push_back(proxy);
+    order.erase(std::find(order.begin(), order.end(), proxy));
+}
+
+auto HinaPE::SweepAndPrune::move_proxy(int proxy, const BBox &box) -> void
+{
+    proxies[proxy].box = box;
+}
+
+auto HinaPE::SweepAndPrune::set_static(int proxy, bool is_static) -> void
+{
+    proxies[proxy].is_static = is_static;
+}
+
+auto HinaPE::SweepAndPrune::clear() -> void
+{
+    proxies.clear();
+    free_proxies.clear();
+    order.clear();
+    active.clear();
+}
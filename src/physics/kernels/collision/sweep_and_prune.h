@@ -0,0 +1,73 @@
+#ifndef HINAPE_SWEEP_AND_PRUNE_H
+#define HINAPE_SWEEP_AND_PRUNE_H
+
+#include "aabb_tree.h"
+
+#include <utility>
+#include <vector>
+
+namespace HinaPE
+{
+// Sort-and-sweep broadphase along x. The sorted order is kept between updates and repaired with an insertion sort,
+// which is close to linear when most boxes don't move (mostly static scenes).
+class SweepAndPrune
+{
+public:
+    auto create_proxy(const BBox &box, unsigned int user_data, bool is_static = false) -> int;
+    auto destroy_proxy(int proxy) -> void;
+    auto move_proxy(int proxy, const BBox &box) -> void;
+    auto set_static(int proxy, bool is_static) -> void;
+    auto clear() -> void;
+
+    template<typename Callback>
+    auto find_pairs(Callback &&callback) -> size_t; // callback(user_data_a, user_data_b) for every overlapping pair but static ones, return overlap tests done
+
+private:
+    struct Proxy
+    {
+        BBox box;
+        unsigned int user_data = 0;
+        bool is_static = false; // two static proxies never pair
+        bool alive = false;
+    };
+    std::vector<Proxy> proxies;
+    std::vector<int> free_proxies;
+    std::vector<int> order; // alive proxies sorted by box.min.x
+    std::vector<int> active;
+};
+
+template<typename Callback>
+auto SweepAndPrune::find_pairs(Callback &&callback) -> size_t
+{
+    // repair the order, cheap for coherent motion
+    for (size_t i = 1; i < order.size(); ++i)
+    {
+        int p = order[i];
+        float key = proxies[p].box.min.x;
+        size_t j = i;
+        for (; j > 0 && proxies[order[j - 1]].box.min.x > key; --j)
+            order[j] = order[j - 1];
+        order[j] = p;
+    }
+
+    size_t tests = 0;
+    active.clear();
+    for (int p: order)
+    {
+        const BBox &box = proxies[p].box;
+        std::erase_if(active, [&](int q) { return proxies[q].box.max.x < box.min.x; });
+        for (int q: active)
+        {
+            if (proxies[q].is_static && proxies[p].is_static)
+                continue;
+            ++tests;
+            if (overlaps(proxies[q].box, box))
+                callback(proxies[q].user_data, proxies[p].user_data);
+        }
+        active.push_back(p);
+    }
+    return tests;
+}
+}
+
+#endif //HINAPE_SWEEP_AND_PRUNE_H
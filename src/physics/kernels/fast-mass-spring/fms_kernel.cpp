@@ -1,109 +1,355 @@
 #include "fms_kernel.h"
 #include "../../physics_system.h"
+#include "../../util/parallel_lib/parallel_for.h"
+#include "../../util/profiler.h"
+
+#include <algorithm>
+#include <limits>
 
 HinaPE::FastMassSpringKernel::FastMassSpringKernel(HinaPE::PhysicsSystem &sys) : physics_system(sys) {}
 
 auto HinaPE::FastMassSpringKernel::init() -> void
 {
-    auto &os = physics_system.physics_objects;
-    for (auto &pair: os)
+    for (auto &e: physics_system.objects<DeformableBase<CLOTH>>())
+        update_cache(*e.body, cloth_cached[e.id], opt.fixed_dt);
+    inited = true;
+}
+
+auto HinaPE::FastMassSpringKernel::simulate(float dt) -> void
+{
+    HINAPE_PROFILE_ZONE("fms.simulate");
+    if (!inited)
+        init();
+
+    // pick the cloths serially (the cache map is not thread safe), then solve them in parallel
+    std::vector<std::pair<DeformableBase<CLOTH> *, ClothCache *>> cloths;
+    for (auto &e: physics_system.objects<DeformableBase<CLOTH>>())
+        cloths.emplace_back(e.body, &cloth_cached[e.id]);
+    std::erase_if(cloth_cached, [&](const auto &pair) { return !physics_system.contains(pair.first); });
+
+    parallel_for(static_cast<size_t>(0), cloths.size(), [&](size_t i)
     {
-        if (pair.second->is<DeformableBase<CLOTH>>())
+        update_cache(*cloths[i].first, *cloths[i].second, dt);
+        simulate_for_each(*cloths[i].first, *cloths[i].second, dt);
+    }, ExecutionPolicy::kParallel, static_cast<size_t>(1));
+
+    // the sweeps share the scratch of PhysicsSystem::ccd, so the cloths go through it one after another
+    if (opt.continuous_collision && !cloths.empty())
+    {
+        physics_system.ccd.update();
+        for (auto &[cloth, cache]: cloths)
         {
-            auto id = pair.first;
-            auto &o = pair.second->get_object<DeformableBase<CLOTH>>();
-
-            auto &verts = o.vertices();
-            auto &edges = o.edges();
-            auto &masses = o.masses();
-            Eigen::Map<Eigen::MatrixXf> M_vertices(verts.data()->data, static_cast<int>(verts.size()), 3);
-            auto vertices_num = M_vertices.rows();
-            auto edges_num = (int) edges.size();
-
-            TripletList LTriplets;
-            SparseMatrix L;
-            L.resize(3 * vertices_num, 3 * vertices_num);
-            unsigned int k = 0;
-            for (auto &edge: edges)
-            {
-                for (int i = 0; i < 3; ++i)
-                {
-                    LTriplets.push_back(Eigen::Triplet<float>(3 * edge.first + i, 3 * edge.second + i, 1.0f));/* TODO: initial stiffness here */
-                    LTriplets.push_back(Eigen::Triplet<float>(3 * edge.first + i, 3 * edge.second + i, -1.0f));
-                    LTriplets.push_back(Eigen::Triplet<float>(3 * edge.second + i, 3 * edge.first + i, -1.0f));
-                    LTriplets.push_back(Eigen::Triplet<float>(3 * edge.second + i, 3 * edge.first + i, 1.0f));
-                }
-                ++k;
-            }
-            L.setFromTriplets(LTriplets.begin(), LTriplets.end());
+            auto &verts = cloth->vertices();
+            if (verts.size() == 0)
+                continue;
+            physics_system.ccd.solve(cache->start, verts, cloth->inv_masses(), cloth->edges());
+            auto &vels = cloth->velocities();
+            for (int axis = 0; axis < 3; ++axis)
+                vels.map(axis) = (verts.map(axis) - cache->start.map(axis)) / dt;
+        }
+    }
 
-            TripletList JTriplets;
-            SparseMatrix J;
-            J.resize(3 * vertices_num, 3 * edges_num);
-            k = 0;
-            for (auto &edge: edges)
-            {
-                for (int i = 0; i < 3; ++i)
-                {
-                    JTriplets.push_back(Eigen::Triplet<float>(3 * edge.first + i, 3 * k + i, 1.0f));/* TODO: initial stiffness here */
-                    JTriplets.push_back(Eigen::Triplet<float>(3 * edge.second + i, 3 * k + i, 1.0f));
-                }
-                ++k;
-            }
-            J.setFromTriplets(JTriplets.begin(), JTriplets.end());
+    last_report = {};
+    self_collision_stats = {};
+    for (auto &cloth: cloths)
+    {
+        if (opt.self_collision)
+            self_collision_stats += cloth.second->self_collision.counters();
+        last_report.iterations = std::max(last_report.iterations, cloth.second->iterations);
+        last_report.total_iterations += cloth.second->iterations;
+        last_report.residual = std::max(last_report.residual, cloth.second->residual);
+    }
+}
+
+auto HinaPE::FastMassSpringKernel::report() const -> const FrameReport &
+{
+    return last_report;
+}
 
-            TripletList MTriplets;
-            SparseMatrix M;
-            M.resize(3 * vertices_num, 3 * vertices_num);
-            k = 0;
-            for (auto &mass: masses)
+auto HinaPE::FastMassSpringKernel::self_collision_counters() const -> const ClothSelfCollision::Counters &
+{
+    return self_collision_stats;
+}
+
+auto HinaPE::FastMassSpringKernel::stable_dt(float cfl) const -> float
+{
+    return std::numeric_limits<float>::infinity();
+}
+
+auto HinaPE::FastMassSpringKernel::save(SnapshotWriter &out) const -> void
+{
+}
+
+auto HinaPE::FastMassSpringKernel::load(SnapshotReader &in) -> void
+{
+    for (auto &[id, cache]: cloth_cached)
+        cache.self_collision.invalidate();
+}
+
+auto HinaPE::FastMassSpringKernel::share_factors(std::shared_ptr<FactorCache> cache) -> void
+{
+    if (factors == cache)
+        return;
+    factors = std::move(cache);
+    for (auto &pair: cloth_cached)
+        pair.second.factor.reset();
+}
+
+auto HinaPE::FastMassSpringKernel::FactorKey::same_topology(const FactorKey &other) const -> bool
+{
+    return edges == other.edges && masses == other.masses && attached == other.attached &&
+           rest_lengths.size() == other.rest_lengths.size() && (rest_lengths.array() == other.rest_lengths.array()).all() &&
+           anchors.rows() == other.anchors.rows() && (anchors.array() == other.anchors.array()).all();
+}
+
+auto HinaPE::FastMassSpringKernel::FactorKey::operator==(const FactorKey &other) const -> bool
+{
+    return stiffness == other.stiffness && h == other.h && attachment_stiffness == other.attachment_stiffness && same_topology(other);
+}
+
+auto HinaPE::FastMassSpringKernel::FactorCache::acquire(FactorKey &&key, std::shared_ptr<const ClothFactor> previous) -> std::shared_ptr<const ClothFactor>
+{
+    // only the lookup runs under the lock: a key already in flight is waited for, and a new one is published before it
+    // is factorized, so variants asking for the same key build it once while different keys build in parallel
+    std::shared_ptr<ClothFactor> factor;
+    std::promise<void> done;
+    auto ready = done.get_future().share();
+    bool analyze = true;
+    {
+        std::unique_lock lock(mutex);
+        std::erase_if(entries, [](const auto &entry) { return entry.factor.expired(); });
+        for (auto &entry: entries)
+            if (auto found = entry.factor.lock(); found && found->key == key)
             {
-                for (int i = 0; i < 3; ++i)
-                {
-                    MTriplets.push_back(Eigen::Triplet<float>(3 * k + i, 3 * k + i, mass));
-                }
-                ++k;
+                auto found_ready = entry.ready;
+                lock.unlock();
+                found_ready.get();
+                return found;
             }
-            M.setFromTriplets(MTriplets.begin(), MTriplets.end());
 
-            SparseMatrix A = M + opt.fixed_dt * opt.fixed_dt * L;
-            auto system_matrix = std::make_shared<CholeskySolver>();
-            system_matrix->compute(A);
+        // the sparsity pattern only depends on the topology, keep the symbolic factorization if nobody else reads previous
+        if (previous && previous.use_count() == 1 && previous->key.same_topology(key))
+        {
+            factor = std::const_pointer_cast<ClothFactor>(previous);
+            factor->key.stiffness = key.stiffness;
+            factor->key.h = key.h;
+            factor->key.attachment_stiffness = key.attachment_stiffness;
+            analyze = false;
+            for (auto &entry: entries)
+                if (!entry.factor.owner_before(factor) && !factor.owner_before(entry.factor))
+                    entry.ready = ready;
+        } else
+        {
+            factor = std::make_shared<ClothFactor>();
+            factor->key = std::move(key);
+            entries.push_back({factor, ready});
+        }
+    }
+    previous.reset();
 
-            Ls_cached[id] = L;
-            Js_cached[id] = J;
-            Ms_cached[id] = M;
-            solver_cached[id] = system_matrix;
+    try
+    {
+        build(*factor, analyze);
+    } catch (...)
+    {
+        done.set_exception(std::current_exception());
+        throw;
+    }
+    done.set_value();
+    return factor;
+}
 
-            
-        }
+auto HinaPE::FastMassSpringKernel::FactorCache::build(ClothFactor &factor, bool analyze) -> void
+{
+    auto &k = factor.key;
+    const auto vertices_num = static_cast<int>(k.masses.size());
+    const auto edges_num = static_cast<int>(k.edges.size());
+    const float stiffness = k.stiffness, dt = k.h;
+    if (analyze)
+    {
+        TripletList MTriplets;
+        MTriplets.reserve(vertices_num);
+        for (int v = 0; v < vertices_num; ++v)
+            MTriplets.emplace_back(v, v, k.masses[v]);
+        factor.M.resize(vertices_num, vertices_num);
+        factor.M.setFromTriplets(MTriplets.begin(), MTriplets.end());
     }
-    inited = true;
+
+    // L = sum k A A^T, J = sum k A S^T, with A = e_a - e_b the incidence vector of a spring
+    TripletList LTriplets, JTriplets;
+    LTriplets.reserve(4 * edges_num);
+    JTriplets.reserve(2 * edges_num);
+    for (int e = 0; e < edges_num; ++e)
+    {
+        auto a = k.edges[e].first, b = k.edges[e].second;
+        LTriplets.emplace_back(a, a, stiffness);
+        LTriplets.emplace_back(a, b, -stiffness);
+        LTriplets.emplace_back(b, a, -stiffness);
+        LTriplets.emplace_back(b, b, stiffness);
+
+        JTriplets.emplace_back(a, e, stiffness);
+        JTriplets.emplace_back(b, e, -stiffness);
+    }
+    factor.L.resize(vertices_num, vertices_num);
+    factor.L.setFromTriplets(LTriplets.begin(), LTriplets.end());
+    factor.J.resize(vertices_num, edges_num);
+    factor.J.setFromTriplets(JTriplets.begin(), JTriplets.end());
+
+    factor.A = factor.M + dt * dt * factor.L;
+    for (int v: k.attached)
+        factor.A.coeffRef(v, v) += dt * dt * k.attachment_stiffness;
+
+    if (analyze)
+        factor.solver.analyzePattern(factor.A);
+    factor.solver.factorize(factor.A);
 }
 
-auto HinaPE::FastMassSpringKernel::simulate(float dt) -> void
+auto HinaPE::FastMassSpringKernel::FactorCache::size() -> size_t
 {
-    if (!inited)
-        init();
-    //    auto &os = physics_system.physics_objects;
-    //    for (auto &pair: os)
-    //    {
-    //        auto &o = pair.second;
-    //        if (o->get_type() == Deformable)
-    //        {
-    //            auto &pos = o->get_vertices();
-    //            auto &vel = o->get_velocities();
-    //            auto &mass = o->get_masses();
-    //            Eigen::Map<Eigen::MatrixXf> M_positions(pos.data()->data, static_cast<int>(pos.size()), 3);
-    //            Eigen::Map<Eigen::MatrixXf> M_velocities(vel.data()->data, static_cast<int>(vel.size()), 3);
-    //            Eigen::Map<Eigen::MatrixXf> M_masses(vel.data()->data, static_cast<int>(vel.size()), 3);
-    //
-    //            simulate_for_each(M_positions, M_velocities, M_positions, dt);
-    //        }
-    //    }
+    std::lock_guard lock(mutex);
+    return std::count_if(entries.begin(), entries.end(), [](const auto &entry) { return !entry.factor.expired(); });
+}
+
+auto HinaPE::FastMassSpringKernel::update_cache(DeformableBase<CLOTH> &cloth, ClothCache &cache, float dt) -> void
+{
+    HINAPE_PROFILE_ZONE("fms.update_cache");
+    auto &verts = cloth.vertices();
+    auto &edges = cloth.edges();
+    auto &inv_masses = cloth.inv_masses();
+    const float stiffness = cloth.stiffness();
+    const auto vertices_num = static_cast<int>(verts.size());
+    const auto edges_num = static_cast<int>(edges.size());
+
+    const auto *factor = cache.factor.get();
+    bool topology_changed = !factor || factor->M.rows() != vertices_num || factor->key.edges != edges;
+    if (!topology_changed && factor->key.stiffness == stiffness && factor->key.h == dt && factor->key.attachment_stiffness == opt.attachment_stiffness)
+        return;
+
+    FactorKey key;
+    if (topology_changed)
+    {
+        if (cache.self_collision_edges != edges)
+        {
+            cache.self_collision.set_topology(verts, cloth.indices(), edges);
+            cache.self_collision_edges = edges;
+        }
+        // rest state is the current shape
+        key.edges = edges;
+        key.masses = cloth.masses();
+        key.rest_lengths.resize(edges_num);
+        for (int k = 0; k < edges_num; ++k)
+            key.rest_lengths[k] = (verts.get(edges[k].first) - verts.get(edges[k].second)).norm();
+        key.anchors.resize(vertices_num, 3);
+        for (int axis = 0; axis < 3; ++axis)
+            key.anchors.col(axis) = verts.map(axis);
+        for (int i = 0; i < vertices_num; ++i)
+            if (inv_masses[i] == 0)
+                key.attached.push_back(i);
+    } else
+    {
+        key.edges = factor->key.edges;
+        key.masses = factor->key.masses;
+        key.rest_lengths = factor->key.rest_lengths;
+        key.anchors = factor->key.anchors;
+        key.attached = factor->key.attached;
+    }
+    key.stiffness = stiffness;
+    key.h = dt;
+    key.attachment_stiffness = opt.attachment_stiffness;
+    cache.factor = factors->acquire(std::move(key), std::move(cache.factor));
 }
 
-auto HinaPE::FastMassSpringKernel::simulate_for_each(Eigen::Map<Eigen::MatrixXf> &pos, Eigen::Map<Eigen::MatrixXf> &vel, Eigen::Map<Eigen::MatrixXf> &frc, float dt) -> void
+auto HinaPE::FastMassSpringKernel::simulate_for_each(DeformableBase<CLOTH> &cloth, ClothCache &cache, float dt) -> void
 {
+    HINAPE_PROFILE_ZONE("fms.solve");
+    auto &verts = cloth.vertices();
+    auto &vels = cloth.velocities();
+    auto &masses = cloth.masses();
+    const auto vertices_num = static_cast<int>(verts.size());
+    if (opt.continuous_collision)
+        cache.start = verts;
+    if (vertices_num == 0 || !cache.factor || cache.factor->solver.info() != Eigen::Success)
+        return;
+    const auto &factor = *cache.factor;
+    const auto edges_num = static_cast<int>(factor.key.edges.size());
+
+    const float h2 = dt * dt;
+
+    // constant part of the global step: M y + h^2 f_ext (+ attachments)
+    auto &q = cache.current_state;
+    auto &v = cache.next_iterate; // scratch, holds v(n) until the first iteration
+    q.resize(vertices_num, 3);
+    v.resize(vertices_num, 3);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        q.col(axis) = verts.map(axis);
+        v.col(axis) = vels.map(axis);
+    }
+    cache.inertial_term = factor.M * (q + opt.damping_factor * dt * v);
+    for (int i = 0; i < vertices_num; ++i)
+        cache.inertial_term.row(i) += h2 * masses[i] * opt.gravity.transpose();
+    for (int i: factor.key.attached)
+        cache.inertial_term.row(i) += h2 * opt.attachment_stiffness * factor.key.anchors.row(i);
+
+    auto &x = cache.iterate;
+    x = q + dt * v;
+    cache.spring_directions.resize(edges_num, 3);
+    cache.prev_iterate = x;
+    const float rho2 = opt.spectral_radius * opt.spectral_radius;
+    const float rms = 1.f / std::sqrt(3.f * (float) vertices_num);
+    float omega = 1.f;
+    cache.iterations = 0;
+    cache.residual = 0;
+    for (int iter = 0; iter < opt.iterations; ++iter)
+    {
+        // local step: project every spring onto its rest length
+        {
+            HINAPE_PROFILE_ZONE("fms.local_step");
+            parallel_for(0, edges_num, [&](int k)
+            {
+                auto a = factor.key.edges[k].first, b = factor.key.edges[k].second;
+                Eigen::RowVector3f p = x.row(a) - x.row(b);
+                float len = p.norm();
+                cache.spring_directions.row(k) = len > 0 ? Eigen::RowVector3f(factor.key.rest_lengths[k] * p / len) : Eigen::RowVector3f::Zero();
+            });
+        }
+
+        // global step: back substitution only, the factorization is cached and shared by the three axes
+        {
+            HINAPE_PROFILE_ZONE("fms.global_step");
+            cache.rhs = cache.inertial_term + h2 * (factor.J * cache.spring_directions);
+            cache.next_iterate = factor.solver.solve(cache.rhs);
+        }
+
+        // x(k + 1) = omega (x^(k + 1) - x(k - 1)) + x(k - 1)
+        if (opt.chebyshev)
+        {
+            if (iter < opt.chebyshev_delay)
+                omega = 1.f;
+            else if (iter == opt.chebyshev_delay)
+                omega = 2.f / (2.f - rho2);
+            else
+                omega = 4.f / (4.f - rho2 * omega);
+            if (omega != 1.f)
+                cache.next_iterate = omega * (cache.next_iterate - cache.prev_iterate) + cache.prev_iterate;
+            cache.prev_iterate = x;
+        }
+
+        cache.residual = (cache.next_iterate - x).norm() * rms;
+        x.swap(cache.next_iterate);
+        ++cache.iterations;
+        if (cache.residual < opt.tolerance)
+            break;
+    }
 
+    // write back through zero-copy views of the cloth's streams
+    for (int axis = 0; axis < 3; ++axis)
+        verts.map(axis) = x.col(axis);
+    if (opt.self_collision)
+    {
+        cache.self_collision.opt = opt.self_collision_opt;
+        cache.self_collision.solve(verts, cloth.inv_masses());
+    }
+    for (int axis = 0; axis < 3; ++axis)
+        vels.map(axis) = (verts.map(axis) - q.col(axis)) / dt;
 }
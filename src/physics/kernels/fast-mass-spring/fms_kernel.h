@@ -2,8 +2,13 @@
 #define HINAPE_FMS_KERNEL_H
 
 #include "../../common.h"
+#include "../../physics_objects/deformable.h"
+#include "../../util/snapshot.h"
+#include "../collision/cloth_self_collision.h"
 
+#include <future>
 #include <map>
+#include <mutex>
 
 namespace HinaPE
 {
@@ -32,40 +37,123 @@ public:
 
     struct Opt
     {
-        Eigen::Vector3f gravity;
-        Eigen::Vector3f wind_direction;
-        Eigen::Vector3f wind_speed;
+        Eigen::Vector3f gravity = Eigen::Vector3f(0, -9.8f, 0);
+        Eigen::Vector3f wind_direction = Eigen::Vector3f::Zero();
+        Eigen::Vector3f wind_speed = Eigen::Vector3f::Zero();
         float damping_factor = 0.993f;         // damping factor
         float fixed_dt = 1 / 30.f;
+        int iterations = 10;                   // local/global iterations cap per step
+        float tolerance = 0.f;                 // stop once the rms vertex update of an iteration falls below, 0 disables
+        float attachment_stiffness = 1000.f;   // pulls vertices with zero inverse mass back to their initial position
+
+        // Chebyshev semi-iterative acceleration (Wang 2015)
+        bool chebyshev = false;
+        float spectral_radius = 0.9f;          // estimate of the local/global iteration's convergence rate, in (0, 1)
+        int chebyshev_delay = 5;               // plain iterations before the acceleration kicks in
+
+        bool self_collision = true;            // projected after the solve, the velocities follow the corrected positions
+        ClothSelfCollision::Opt self_collision_opt;
+        bool continuous_collision = true;      // against the static colliders of PhysicsSystem::ccd, after the self-collision
     };
     Opt opt;
 
+    struct FrameReport
+    {
+        int iterations = 0; // max iterations used by a cloth in the last step
+        int total_iterations = 0; // summed over all cloths
+        float residual = 0; // largest final rms update
+    };
+    auto report() const -> const FrameReport &;
+    auto self_collision_counters() const -> const ClothSelfCollision::Counters &; // summed over all cloths of the last step
+    auto stable_dt(float cfl) const -> float; // implicit integration, never bounded
+    auto save(SnapshotWriter &out) const -> void; // nothing: the factorizations only depend on topology, stiffness and dt, they stay cached across a load
+    auto load(SnapshotReader &in) -> void; // drops the self-collision candidates found around the positions before the jump
+
     //typedef std::pair<unsigned int, unsigned int> Edge;
     //typedef std::vector<Edge> EdgeList;
 
     mass_spring_system* system;
 
-    Eigen::VectorXf current_state; // q(n), current state
-    Eigen::VectorXf prev_state; // q(n - 1), previous state
-    Eigen::VectorXf spring_directions; // d, spring directions
-    Eigen::VectorXf inertial_term; // M * y, y = (a + 1) * q(n) - a * q(n - 1)
-
 
 public:
     explicit FastMassSpringKernel(PhysicsSystem &sys);
 
+public:
+    // the read-only part of a cloth's solver state, it only depends on what the key holds: cloths of different contexts
+    // that agree on it (e.g. the variants of an Ensemble sweeping the damping) share one factorization
+    struct FactorKey
+    {
+        std::vector<std::pair<int, int>> edges; // topology the matrices were built for
+        std::vector<float> masses;
+        Eigen::VectorXf rest_lengths;
+        Eigen::MatrixX3f anchors; // initial positions, used by attachments
+        std::vector<int> attached;
+        float stiffness = 0;
+        float h = 0;
+        float attachment_stiffness = 0;
+
+        auto same_topology(const FactorKey &other) const -> bool; // all but stiffness, h and attachment_stiffness
+        auto operator==(const FactorKey &other) const -> bool;
+    };
+    struct ClothFactor
+    {
+        FactorKey key;
+        // the system matrix is the same for the three axes, so it is built and factorized once at N x N
+        SparseMatrix M, L, J; // mass, stiffness-weighted laplacian, spring-to-vertex projection
+        SparseMatrix A; // M + h^2 L (+ attachments)
+        CholeskySolver solver;
+    };
+    // factorizations handed out by key, thread safe; a kernel owns one unless share_factors hands it another
+    class FactorCache
+    {
+    public:
+        auto acquire(FactorKey &&key, std::shared_ptr<const ClothFactor> previous) -> std::shared_ptr<const ClothFactor>; // previous is refactorized in place if nobody else holds it and only stiffness, h or attachment_stiffness changed
+        auto size() -> size_t; // factorizations still held by some cloth
+
+    private:
+        struct Entry
+        {
+            std::weak_ptr<ClothFactor> factor;
+            std::shared_future<void> ready; // set once the factorization is done, waiters block on it outside the lock
+        };
+        static auto build(ClothFactor &factor, bool analyze) -> void; // matrices and numeric factorization of factor.key
+        std::mutex mutex;
+        std::vector<Entry> entries;
+    };
+    auto share_factors(std::shared_ptr<FactorCache> cache) -> void; // the cloths of this kernel pick their factorizations from cache from now on
+
 private:
-    auto simulate_for_each(Eigen::Map<Eigen::MatrixXf> &pos, Eigen::Map<Eigen::MatrixXf> &vel, Eigen::Map<Eigen::MatrixXf> &frc, float dt) -> void;
+    // everything one cloth needs between steps: the shared factorization, rebuilt only when its key changes, and the
+    // per-axis scratch, N x 3 (or E x 3) matrices whose columns line up with the x/y/z streams of the cloth
+    struct ClothCache
+    {
+        std::shared_ptr<const ClothFactor> factor;
+
+        Eigen::MatrixX3f inertial_term; // M * y, y = q(n) + h * v(n)
+        Eigen::MatrixX3f spring_directions; // d, spring directions
+        Eigen::MatrixX3f rhs;
+        Eigen::MatrixX3f current_state; // q(n)
+        Eigen::MatrixX3f iterate, prev_iterate, next_iterate; // x(k), Chebyshev x(k - 1) and scratch
+
+        int iterations = 0;
+        float residual = 0;
+
+        ClothSelfCollision self_collision;
+        std::vector<std::pair<int, int>> self_collision_edges; // topology the self-collision was set up for
+        Vec3Stream start; // q(n) as a stream, the continuous collision sweeps from it
+    };
+    auto update_cache(DeformableBase<CLOTH> &cloth, ClothCache &cache, float dt) -> void;
+    auto simulate_for_each(DeformableBase<CLOTH> &cloth, ClothCache &cache, float dt) -> void;
 
 private:
     PhysicsSystem &physics_system;
     bool inited = false;
 
-    // first: cloth id, second: cached sparse matrix
-    std::map<unsigned int, SparseMatrix> Ms_cached;
-    std::map<unsigned int, SparseMatrix> Ls_cached;
-    std::map<unsigned int, SparseMatrix> Js_cached;
-    std::map<unsigned int, std::shared_ptr<CholeskySolver>> solver_cached;
+    // first: cloth id, second: cached solver state
+    std::map<unsigned int, ClothCache> cloth_cached;
+    std::shared_ptr<FactorCache> factors = std::make_shared<FactorCache>();
+    FrameReport last_report;
+    ClothSelfCollision::Counters self_collision_stats;
 
 private:
     typedef std::vector<unsigned int> IndexList;
@@ -86,8 +174,8 @@ public:
     mass_spring_system* getResult();
 protected:
     std::unordered_map<unsigned int, Eigen::Vector3f> fix_map;
-    virtual void fixPoint(unsigned int i);
-    virtual void releasePoint(unsigned int i);
+    void fixPoint(unsigned int i);
+    void releasePoint(unsigned int i);
     bool is_fixed();
 };
 }
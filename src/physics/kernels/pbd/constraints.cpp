@@ -1,5 +1,14 @@
 #include "constraints.h"
-void HinaPE::DistanceConstraint::solve()
+void HinaPE::DistanceConstraint::solve(Vec3Stream &positions, const std::vector<float> &inv_masses)
 {
-
+    float w = inv_masses[i] + inv_masses[j];
+    if (w <= 0)
+        return;
+    Vec3 d = positions.get(i) - positions.get(j);
+    float len = d.norm();
+    if (len <= 0)
+        return;
+    Vec3 correction = d * (stiffness * (len - rest_length) / (len * w));
+    positions.add(i, -inv_masses[i] * correction);
+    positions.add(j, inv_masses[j] * correction);
 }
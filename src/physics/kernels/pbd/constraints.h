@@ -1,16 +1,25 @@
 #ifndef HINAPE_CONSTRAINTS_H
 #define HINAPE_CONSTRAINTS_H
 
+#include "../../common.h"
+#include "../../util/vec3_stream.h"
+
+#include <vector>
+
 namespace HinaPE
 {
 struct Constraint
 {
-    virtual void solve() = 0;
+    virtual void solve(Vec3Stream &positions, const std::vector<float> &inv_masses) = 0;
 };
 
-struct DistanceConstraint : public Constraint
+struct DistanceConstraint final : public Constraint
 {
-    void solve() override;
+    int i = 0, j = 0;
+    float rest_length = 0;
+    float stiffness = 1; // in [0, 1], per projection
+
+    void solve(Vec3Stream &positions, const std::vector<float> &inv_masses) override;
 };
 }
 
@@ -1,36 +1,133 @@
 #include "pbd_kernel.h"
 #include "../../physics_system.h"
+#include "../../util/parallel_lib/parallel_for.h"
+#include "../../util/simd_integrate.h"
+#include "../../util/profiler.h"
+
+#include <cmath>
+#include <limits>
+
+HinaPE::PBDKernel::PBDKernel(HinaPE::PhysicsSystem &sys) : physics_system(sys) {}
 
 void HinaPE::PBDKernel::simulate(float dt)
 {
+    HINAPE_PROFILE_ZONE("pbd.simulate");
+    std::erase_if(cloth_constraints, [&](const auto &pair) { return !physics_system.contains(pair.first); });
+    collision_detection();
+    self_collision_stats = {};
+    for (auto &e: physics_system.objects<DeformableBase<CLOTH>>())
+    {
+        auto &cloth = *e.body;
+        auto &cs = cloth_constraints[e.id];
+        init(cloth, cs);
+        prediction(cloth, cs, dt);
+        project_constraint(cloth, cs);
+        if (opt.self_collision)
+        {
+            cs.self_collision.opt = opt.self_collision_opt;
+            cs.self_collision.solve(cs.predicted, cloth.inv_masses());
+            self_collision_stats += cs.self_collision.counters();
+        }
+        if (opt.continuous_collision)
+            physics_system.ccd.solve(cloth.vertices(), cs.predicted, cloth.inv_masses(), cloth.edges());
+        update_states(cloth, cs, dt);
+    }
 }
 
-void HinaPE::PBDKernel::init(const HinaPE::PBDKernel::Opt &opt)
+auto HinaPE::PBDKernel::stable_dt(float cfl) const -> float
 {
-
+    float speed = 0;
+    for (auto &e: physics_system.objects<DeformableBase<CLOTH>>())
+        speed = std::max(speed, e.body->velocities().max_norm());
+    return speed > 0 ? cfl * opt.self_collision_opt.thickness / speed : std::numeric_limits<float>::infinity();
 }
 
-void HinaPE::PBDKernel::prediction(HinaPE::PhysicsObject &o)
+auto HinaPE::PBDKernel::self_collision_counters() const -> const ClothSelfCollision::Counters &
 {
+    return self_collision_stats;
 }
 
-void HinaPE::PBDKernel::collision_detection()
+auto HinaPE::PBDKernel::save(SnapshotWriter &out) const -> void
 {
+}
 
+auto HinaPE::PBDKernel::load(SnapshotReader &in) -> void
+{
+    // the self-collision candidates were found around the positions before the jump
+    for (auto &[id, cs]: cloth_constraints)
+        cs.self_collision.invalidate();
 }
 
-void HinaPE::PBDKernel::project_constraint()
+void HinaPE::PBDKernel::init(DeformableBase<CLOTH> &cloth, ClothConstraints &cs)
 {
+    HINAPE_PROFILE_ZONE("pbd.init");
+    auto &edges = cloth.edges();
+    // iteration count independent stiffness, k' = 1 - (1 - k)^(1 / n)
+    float stiffness = 1.f - std::pow(1.f - std::clamp(cloth.stiffness(), 0.f, 1.f), 1.f / (float) std::max(opt.iterations, 1));
+    if (cs.edges == edges && !cs.distance.empty())
+    {
+        if (cs.stiffness != stiffness)
+            for (auto &c: cs.distance)
+                c.stiffness = stiffness;
+        cs.stiffness = stiffness;
+        return;
+    }
 
+    // topology changed: rebuild the constraints (rest state is the current shape) and recolor them
+    auto &verts = cloth.vertices();
+    cs.distance.resize(edges.size());
+    for (size_t k = 0; k < edges.size(); ++k)
+    {
+        auto &c = cs.distance[k];
+        c.i = edges[k].first;
+        c.j = edges[k].second;
+        c.rest_length = (verts.get(c.i) - verts.get(c.j)).norm();
+        c.stiffness = stiffness;
+    }
+    cs.coloring.build(static_cast<unsigned int>(cs.distance.size()), static_cast<unsigned int>(verts.size()), [&](unsigned int c, auto &&func)
+    {
+        func(cs.distance[c].i);
+        func(cs.distance[c].j);
+    });
+    cs.self_collision.set_topology(verts, cloth.indices(), edges);
+    cs.edges = edges;
+    cs.stiffness = stiffness;
 }
 
-void HinaPE::PBDKernel::update_states()
+void HinaPE::PBDKernel::prediction(DeformableBase<CLOTH> &cloth, ClothConstraints &cs, float dt)
 {
-
+    HINAPE_PROFILE_ZONE("pbd.prediction");
+    cs.predicted = cloth.vertices();
+    integrate(cs.predicted, cloth.velocities(), cloth.inv_masses(), opt.gravity, dt); // semi-implicit euler
 }
 
-void HinaPE::PBDKernel::semi_implicit_euler(HinaPE::PBDKernel::real h, HinaPE::PBDKernel::real mass, Vec3 &position, Vec3 &velocity, const Vec3 &acceleration)
+void HinaPE::PBDKernel::collision_detection()
 {
+    HINAPE_PROFILE_ZONE("pbd.collision_detection");
+    physics_system.collision.update(); // broadphase only, no contact is resolved yet
+    if (opt.continuous_collision)
+        physics_system.ccd.update();
+}
 
+void HinaPE::PBDKernel::project_constraint(DeformableBase<CLOTH> &cloth, ClothConstraints &cs)
+{
+    HINAPE_PROFILE_ZONE("pbd.project_constraint");
+    auto &inv_masses = cloth.inv_masses();
+    auto &p = cs.predicted;
+    for (int iter = 0; iter < opt.iterations; ++iter)
+    {
+        // Gauss-Seidel over the batches, the constraints of one batch share no particle and run in parallel
+        for (auto &batch: cs.coloring.batches)
+            parallel_for(static_cast<size_t>(0), batch.size(), [&](size_t k) { cs.distance[batch[k]].solve(p, inv_masses); });
+        for (auto c: cs.coloring.conflicts)
+            cs.distance[c].solve(p, inv_masses);
+    }
 }
 
+void HinaPE::PBDKernel::update_states(DeformableBase<CLOTH> &cloth, ClothConstraints &cs, float dt)
+{
+    HINAPE_PROFILE_ZONE("pbd.update_states");
+    auto &verts = cloth.vertices();
+    update_velocities(cloth.velocities(), cs.predicted, verts, dt);
+    verts.swap(cs.predicted);
+}
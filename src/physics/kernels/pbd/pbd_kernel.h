@@ -2,6 +2,13 @@
 #define HINAPE_PBD_KERNEL_H
 
 #include "../../common.h"
+#include "../../physics_objects/deformable.h"
+#include "../../util/graph_coloring.h"
+#include "../../util/snapshot.h"
+#include "../collision/cloth_self_collision.h"
+#include "constraints.h"
+
+#include <map>
 
 namespace HinaPE
 {
@@ -15,21 +22,46 @@ public:
     struct Opt
     {
         float dt = 1 / 30.f;
+        int iterations = 10;
+        Vec3 gravity = Vec3(0.f, -9.8f, 0.f);
+        bool self_collision = true;
+        ClothSelfCollision::Opt self_collision_opt;
+        bool continuous_collision = true; // against the static colliders of PhysicsSystem::ccd
     };
     Opt opt;
 
+    auto stable_dt(float cfl) const -> float; // largest step moving no particle farther than cfl times the self-collision thickness, infinity if unbounded
+    auto self_collision_counters() const -> const ClothSelfCollision::Counters &; // summed over all cloths of the last step
+    auto save(SnapshotWriter &out) const -> void; // no state outlives a step, the constraints follow the topology
+    auto load(SnapshotReader &in) -> void;
+
+public:
+    explicit PBDKernel(PhysicsSystem &sys);
+
 private:
-    void init(const Opt &opt);
-    void prediction(class PhysicsObject &);
+    // constraints of one cloth and their color batches, rebuilt only when the topology changes
+    struct ClothConstraints
+    {
+        std::vector<DistanceConstraint> distance;
+        ConstraintColoring coloring;
+        std::vector<std::pair<int, int>> edges; // topology the constraints were built for
+        float stiffness = -1;
+        Vec3Stream predicted;
+        ClothSelfCollision self_collision;
+    };
+
+    void init(DeformableBase<CLOTH> &, ClothConstraints &);
+    void prediction(DeformableBase<CLOTH> &, ClothConstraints &, float dt);
     void collision_detection();
-    void project_constraint();
-    void update_states();
+    void project_constraint(DeformableBase<CLOTH> &, ClothConstraints &);
+    void update_states(DeformableBase<CLOTH> &, ClothConstraints &, float dt);
 
-private: // time integration
-    using real = float;
-    void semi_implicit_euler(real h, real mass, Vec3 &position, Vec3 &velocity, const Vec3 &acceleration);
+private:
+    PhysicsSystem &physics_system;
+    std::map<unsigned int, ClothConstraints> cloth_constraints;
+    ClothSelfCollision::Counters self_collision_stats;
 };
 
 }
 
-#endif //HINAPE_PBD_KERN
\ No newline at end of file
+#endif //HINAPE_PBD_KERNEL_H
@@ -0,0 +1,184 @@
+#include "rigid_solver.h"
+#include "../../physics_system.h"
+#include "../../util/parallel_lib/parallel_for.h"
+#include "../../util/profiler.h"
+
+#include <algorithm>
+#include <climits>
+#include <numeric>
+
+HinaPE::RigidBodySolver::RigidBodySolver(HinaPE::PhysicsSystem &sys) : physics_system(sys) {}
+
+void HinaPE::RigidBodySolver::simulate(float dt)
+{
+    HINAPE_PROFILE_ZONE("rigid.simulate");
+    auto bodies = physics_system.objects<RigidBodyBase<DYNAMIC>>();
+    stats = {};
+    stats.bodies = bodies.size();
+    if (bodies.empty())
+        return;
+
+    physics_system.collision.update_if_stale(); // the pairs of the deformable kernel's collision stage, if it ran one
+    build_islands();
+
+    // an island with one awake body is awake as a whole: awake bodies wake the bodies they overlap
+    awake_islands.clear();
+    for (unsigned int k = 0; k + 1 < island_start.size(); ++k)
+    {
+        bool awake = !opt.sleeping;
+        for (auto i = island_start[k]; i < island_start[k + 1] && !awake; ++i)
+            awake = !bodies[island_bodies[i]].body->impl->sleeping;
+        if (!awake)
+            continue;
+        for (auto i = island_start[k]; i < island_start[k + 1]; ++i)
+            if (auto &b = *bodies[island_bodies[i]].body->impl; b.sleeping || b.sleep_group)
+            {
+                b.sleeping = false;
+                b.still_frames = 0;
+                b.sleep_group = 0;
+            }
+        awake_islands.push_back(k);
+        stats.awake_bodies += island_start[k + 1] - island_start[k];
+    }
+    stats.awake_islands = awake_islands.size();
+
+    // islands share no body, they are integrated in parallel
+    HINAPE_PROFILE_ZONE("rigid.solve");
+    fell_asleep.assign(awake_islands.size(), 0);
+    parallel_for(static_cast<size_t>(0), awake_islands.size(), [&](size_t k) { fell_asleep[k] = solve_island(awake_islands[k], dt); });
+    for (size_t k = 0; k < awake_islands.size(); ++k)
+    {
+        if (!fell_asleep[k])
+            continue;
+        auto group = next_sleep_group++;
+        for (auto i = island_start[awake_islands[k]]; i < island_start[awake_islands[k] + 1]; ++i)
+            bodies[island_bodies[i]].body->impl->sleep_group = group;
+    }
+}
+
+auto HinaPE::RigidBodySolver::counters() const -> const Counters &
+{
+    return stats;
+}
+
+auto HinaPE::RigidBodySolver::save(SnapshotWriter &out) const -> void
+{
+    out.value(next_sleep_group);
+}
+
+auto HinaPE::RigidBodySolver::load(SnapshotReader &in) -> void
+{
+    in.value(next_sleep_group);
+}
+
+auto HinaPE::RigidBodySolver::find(unsigned int i) -> unsigned int
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]]; // path halving
+        i = parent[i];
+    }
+    return i;
+}
+
+auto HinaPE::RigidBodySolver::unite(unsigned int a, unsigned int b) -> void
+{
+    a = find(a);
+    b = find(b);
+    if (a == b)
+        return;
+    if (rank[a] < rank[b])
+        std::swap(a, b);
+    parent[b] = a;
+    if (rank[a] == rank[b])
+        ++rank[a];
+}
+
+auto HinaPE::RigidBodySolver::build_islands() -> void
+{
+    HINAPE_PROFILE_ZONE("rigid.islands");
+    auto bodies = physics_system.objects<RigidBodyBase<DYNAMIC>>();
+    const auto n = static_cast<unsigned int>(bodies.size());
+    index_of.clear();
+    for (unsigned int i = 0; i < n; ++i)
+        index_of[bodies[i].id] = i;
+
+    // static bodies do not join islands, otherwise everything resting on the ground would be one island
+    parent.resize(n);
+    std::iota(parent.begin(), parent.end(), 0u);
+    rank.assign(n, 0);
+    for (auto &[a, b]: physics_system.collision.pairs())
+    {
+        auto ia = index_of.find(a), ib = index_of.find(b);
+        if (ia == index_of.end() || ib == index_of.end())
+            continue;
+        unite(ia->second, ib->second);
+        ++stats.contacts;
+    }
+
+    // sleeping bodies report no pair with each other, their islands are kept from when they fell asleep
+    group_body.clear();
+    for (unsigned int i = 0; i < n; ++i)
+        if (auto group = bodies[i].body->impl->sleep_group)
+        {
+            auto [it, first] = group_body.try_emplace(group, i);
+            if (!first)
+                unite(it->second, i);
+        }
+
+    // group the bodies by island (counting sort over the roots)
+    root_island.assign(n, UINT_MAX);
+    island_of.resize(n);
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        auto root = find(i);
+        if (root_island[root] == UINT_MAX)
+            root_island[root] = count++;
+        island_of[i] = root_island[root];
+    }
+    island_start.assign(count + 1, 0);
+    for (unsigned int i = 0; i < n; ++i)
+        ++island_start[island_of[i] + 1];
+    std::partial_sum(island_start.begin(), island_start.end(), island_start.begin());
+    island_bodies.resize(n);
+    root_island.assign(island_start.begin(), island_start.end() - 1); // reused as the fill cursor
+    for (unsigned int i = 0; i < n; ++i)
+        island_bodies[root_island[island_of[i]]++] = i;
+    stats.islands = count;
+}
+
+auto HinaPE::RigidBodySolver::solve_island(unsigned int island, float dt) -> bool
+{
+    auto bodies = physics_system.objects<RigidBodyBase<DYNAMIC>>();
+    int still_frames = INT_MAX;
+    for (auto k = island_start[island]; k < island_start[island + 1]; ++k)
+    {
+        auto &b = *bodies[island_bodies[k]].body->impl;
+
+        // semi-implicit euler, forces are consumed by the step (torques are left alone, the bodies carry no inertia yet)
+        b.v += (b.f * b.im + b.a) * dt;
+        b.v *= 1.f / (1.f + dt * b.ld);
+        b.w *= 1.f / (1.f + dt * b.ad);
+        b.p += b.v * dt;
+        b.q = (b.q + Quat(b.w, 0.f) * b.q * (0.5f * dt)).unit();
+        b.f = Vec3();
+
+        if (b.v.norm() < opt.linear_sleep_threshold && b.w.norm() < opt.angular_sleep_threshold)
+            ++b.still_frames;
+        else
+            b.still_frames = 0;
+        still_frames = std::min(still_frames, b.still_frames);
+    }
+
+    if (!opt.sleeping || still_frames < opt.sleep_frames)
+        return false;
+    for (auto k = island_start[island]; k < island_start[island + 1]; ++k)
+    {
+        auto &b = *bodies[island_bodies[k]].body->impl;
+        b.sleeping = true;
+        b.v = Vec3();
+        b.w = Vec3();
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef HINAPE_RIGID_SOLVER_H
+#define HINAPE_RIGID_SOLVER_H
+
+#include "../../common.h"
+#include "../../util/snapshot.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace HinaPE
+{
+class PhysicsSystem;
+
+// Integrates the dynamic rigid bodies island by island, from what was applied to them (velocities, add_force,
+// add_acceleration): there is no gravity and no contact response, a body nobody pushes stays where it is.
+// Islands are the connected components of the broadphase overlap graph (pairs between dynamic bodies), rebuilt with a
+// union-find every step. An island falls asleep when all its bodies stayed under the velocity thresholds for
+// sleep_frames steps, it is skipped until one of its bodies overlaps an awake body or gets a force or a velocity.
+// Sleeping bodies are static to the broadphase, so the bodies of a sleeping island are kept together by their sleep group.
+class RigidBodySolver
+{
+public:
+    void simulate(float dt);
+
+    struct Opt
+    {
+        bool sleeping = true;
+        float linear_sleep_threshold = 0.05f; // m/s
+        float angular_sleep_threshold = 0.05f; // rad/s
+        int sleep_frames = 30;
+    };
+    Opt opt;
+
+    struct Counters
+    {
+        size_t bodies = 0;
+        size_t awake_bodies = 0;
+        size_t contacts = 0; // edges of the overlap graph, broadphase pairs between dynamic bodies
+        size_t islands = 0;
+        size_t awake_islands = 0;
+    };
+    auto counters() const -> const Counters &;
+    auto save(SnapshotWriter &out) const -> void; // the bodies save themselves, this is the sleep group counter
+    auto load(SnapshotReader &in) -> void;
+
+public:
+    explicit RigidBodySolver(PhysicsSystem &sys);
+
+private:
+    auto find(unsigned int i) -> unsigned int;
+    auto unite(unsigned int a, unsigned int b) -> void;
+    auto build_islands() -> void;
+    auto solve_island(unsigned int island, float dt) -> bool; // true: the island fell asleep
+
+    PhysicsSystem &physics_system;
+    std::unordered_map<unsigned int, unsigned int> index_of; // object id -> index into objects<RigidBodyBase<DYNAMIC>>()
+
+    // union-find forest, then the bodies grouped by island: island k holds island_bodies[island_start[k], island_start[k + 1])
+    std::vector<unsigned int> parent, rank, root_island;
+    std::vector<unsigned int> island_start, island_bodies, island_of;
+    std::vector<unsigned int> awake_islands;
+    std::unordered_map<unsigned int, unsigned int> group_body; // sleep group -> first body seen in it
+    std::vector<char> fell_asleep; // per awake island
+    unsigned int next_sleep_group = 1;
+    Counters stats;
+};
+}
+
+#endif //HINAPE_RIGID_SOLVER_H
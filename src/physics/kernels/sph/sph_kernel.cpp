@@ -1,107 +1,168 @@
 #include "sph_kernel.h"
+#include "../../util/parallel_lib/parallel_for.h"
+#include "../../util/profiler.h"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #define PI 3.14
 
 auto HinaPE::SPHKernel::init_particle_system() -> void {
 
 }
 
+auto HinaPE::SPHKernel::add_particle(const Vec3 &position, const Vec3 &velocity) -> unsigned int {
+    return particles.add(MASS, position, velocity);
+}
+
 auto HinaPE::SPHKernel::buildTable() -> void {
-    for(int i = 0; i < 1000000;i++){
-        particleTable[i] = nullptr;
-    }
-    /// build hash table
-    Particle* p;
-    for(auto & particle : particles){
-        p = particle;
-        /// insert each particle into the hash table
-        int index = getHash(getCell(p));
-
-        if (particleTable[index] == nullptr) {
-            p->next = nullptr;
-            particleTable[index] = p;
-        }
-        else {
-            p->next = particleTable[index];
-            particleTable[index] = p;
-        }
-    }
+    HINAPE_PROFILE_ZONE("sph.build_table");
+    /// counting sort of the particles by hash bucket
+    const auto n = static_cast<unsigned int>(particles.size());
+    const auto buckets = std::max(2 * n, 1u);
+    grid.cell_start.assign(buckets + 1, 0);
+    grid.particle_bucket.resize(n);
+    grid.order.resize(n);
+
+    parallel_for(0u, n, [&](unsigned int i) { grid.particle_bucket[i] = getHash(getCell(particles.x[i], particles.y[i], particles.z[i])) % buckets; });
+    for (unsigned int i = 0; i < n; i++)
+        grid.cell_start[grid.particle_bucket[i]]++;
+    parallel_exclusive_scan(grid.cell_start.begin(), grid.cell_start.end(), grid.cell_start.begin(), 0u);
+
+    /// scatter, cell_start[b] ends up at the end of bucket b and is shifted back below
+    for (unsigned int i = 0; i < n; i++)
+        grid.order[grid.cell_start[grid.particle_bucket[i]]++] = i;
+    for (unsigned int b = buckets; b > 0; b--)
+        grid.cell_start[b] = grid.cell_start[b - 1];
+    grid.cell_start[0] = 0;
+
+    /// particles of the same cell are now contiguous
+    particles.reorder(grid.order);
+}
+
+auto HinaPE::SPHKernel::stable_dt(float cfl) const -> float {
+    float speed2 = 0;
+    for (size_t i = 0; i < particles.size(); i++)
+        speed2 = std::max(speed2, particles.vx[i] * particles.vx[i] + particles.vy[i] * particles.vy[i] + particles.vz[i] * particles.vz[i]);
+    return speed2 > 0 ? cfl * h / std::sqrt(speed2) : std::numeric_limits<float>::infinity();
+}
+
+auto HinaPE::SPHKernel::save(SnapshotWriter &out) const -> void {
+    particles.save(out);
+    out.value(opt.current_time);
+}
+
+auto HinaPE::SPHKernel::load(SnapshotReader &in) -> void {
+    particles.load(in);
+    in.value(opt.current_time);
 }
 
-auto HinaPE::SPHKernel::getHash(Vec3 cell) -> unsigned int {
-    /// Compact hash table
-    cell.x *= 73856093;
-    cell.y *= 19349663;
-    cell.z *= 83492791;
-    return ((unsigned int)cell.x ^ (unsigned int)cell.y ^ (unsigned int)cell.z) % 1000000;
+auto HinaPE::SPHKernel::getHash(const Point<int, 3> &cell) const -> unsigned int {
+    return ((unsigned int) cell.x * 73856093u) ^ ((unsigned int) cell.y * 19349663u) ^ ((unsigned int) cell.z * 83492791u);
 }
 
-auto HinaPE::SPHKernel::getCell(Particle *p) const -> Vec3 {
+auto HinaPE::SPHKernel::getCell(float x, float y, float z) const -> Point<int, 3> {
     /// position of the particle in the grid
-    return Vec3(p->position.x / h, p->position.y / h, p->position.z / h);
+    return Point<int, 3>((int) std::floor(x / h), (int) std::floor(y / h), (int) std::floor(z / h));
 }
 
 auto HinaPE::SPHKernel::simulate(float dt) -> void
 {
+    HINAPE_PROFILE_ZONE("sph.simulate");
+    particles.compact();
     buildTable();
-    for(auto pi : particles){
-        float pDensity = 0;
-        Vec3 cell = getCell(pi);
-        for(int i = -1; i <= 1; i++){
-            for(int j = -1; j <= 1; j++){
-                for(int k = -1; k <= 1; k++){
-                    Vec3 neighborCell = cell + Vec3(i,j,k);
-                    int index = getHash(neighborCell);
-                    Particle* pj = particleTable[index];
-                    while(pj != nullptr){
-                        float r_norm = (pi->position - pj->position).norm();
-                        if(r_norm < h){
-                            pDensity += MASS * 315.0f / (64.0f * PI * pow(h, 9)) * pow(H2 - dist2, 3);
-                        }
-                        pj = pj->next;
+    const auto n = static_cast<unsigned int>(particles.size());
+    const auto buckets = static_cast<unsigned int>(grid.cell_start.size() - 1);
+    const float H2 = h * h;
+    const float poly6 = 315.0f / (64.0f * PI * std::pow(h, 9));
+    const float spiky = 45.0f / (PI * std::pow(h, 6));
+
+    const float *x = particles.x.data(), *y = particles.y.data(), *z = particles.z.data();
+    const float *vx = particles.vx.data(), *vy = particles.vy.data(), *vz = particles.vz.data();
+    const float *mass = particles.mass.data();
+    float *density = particles.density.data(), *pressure = particles.pressure.data();
+    float *fx = particles.fx.data(), *fy = particles.fy.data(), *fz = particles.fz.data();
+
+    /// visit every particle j != i of the 27 cells around i, each bucket is a contiguous range of the streams
+    auto for_each_neighbor = [&](unsigned int i, auto &&func)
+    {
+        Point<int, 3> cell = getCell(x[i], y[i], z[i]);
+        unsigned int visited[27];
+        int visited_count = 0;
+        for (int a = -1; a <= 1; a++)
+            for (int b = -1; b <= 1; b++)
+                for (int c = -1; c <= 1; c++)
+                {
+                    unsigned int bucket = getHash(Point<int, 3>(cell.x + a, cell.y + b, cell.z + c)) % buckets;
+                    /// two of the 27 cells may hash to the same bucket, scan it only once
+                    if (std::find(visited, visited + visited_count, bucket) != visited + visited_count)
+                        continue;
+                    visited[visited_count++] = bucket;
+                    const unsigned int end = grid.cell_start[bucket + 1];
+                    for (unsigned int j = grid.cell_start[bucket]; j < end; j++)
+                    {
+                        float rx = x[i] - x[j], ry = y[i] - y[j], rz = z[i] - z[j];
+                        float dist2 = rx * rx + ry * ry + rz * rz;
+                        if (j != i && dist2 < H2)
+                            func(j, rx, ry, rz, dist2);
                     }
                 }
-            }
-        }
-        /// Include self density
-        pi->density = pDensity + self_density;
-
-        ///  Calculate pressure
-        pi->pressure = eosScale * pow(pi->density / targetDensity - 1, eosExponent);
+    };
+
+    {
+        HINAPE_PROFILE_ZONE("sph.density");
+        parallel_for(0u, n, [&](unsigned int i)
+        {
+            float pDensity = 0;
+            for_each_neighbor(i, [&](unsigned int j, float, float, float, float dist2)
+            {
+                float d = H2 - dist2;
+                pDensity += mass[j] * poly6 * d * d * d;
+            });
+            /// Include self density
+            density[i] = pDensity + self_density;
+
+            ///  Calculate pressure
+            pressure[i] = eosScale * std::pow(density[i] / targetDensity - 1, eosExponent);
+        });
     }
 
     /// calculate forces
-    for (auto pi : particles){
-        pi->force = Vec3(0.0f, 0.0f, 0.0f);
-        Vec3 cell = getCell(pi);
-
-        for(int i = -1; i <= 1; i++){
-            for(int j = -1; j <= 1; j++){
-                for(int k = -1; k <= 1; k++){
-                    Vec3 neighborCell = cell + Vec3(i,j,k);
-                    int index = getHash(neighborCell);
-                    Particle* pj = particleTable[index];
-                    while(pj != nullptr){
-                        float r_norm = (pi->position - pj->position).norm();
-                        if(r_norm < h){
-                            Vec3 r = pi->position - pj->position;
-                            Vec3 pressureForce = -dir * MASS * (pi->pressure + pj->pressure) / (2 * pj->density) * (-45.0f / (PI * pow(h, 6)));
-                            Vec3 viscosityForce = (viscosity * MASS / pj->density) * (pj->velocity - pi->velocity) * (h - dist) * (45.0f / (PI * pow(h, 6)));
-                            pi->force += pressureForce + viscosityForce;
-                        }
-                        pj = pj->next;
-                    }
-                }
-            }
-        }
+    {
+        HINAPE_PROFILE_ZONE("sph.forces");
+        parallel_for(0u, n, [&](unsigned int i)
+        {
+            float f[3] = {0.0f, 0.0f, 0.0f};
+            for_each_neighbor(i, [&](unsigned int j, float rx, float ry, float rz, float dist2)
+            {
+                float dist = std::sqrt(dist2);
+                if (dist <= 0)
+                    return;
+                float pressureScale = mass[j] * (pressure[i] + pressure[j]) / (2 * density[j]) * spiky / dist; // -dir * m * p / 2rho * -spiky
+                float viscosityScale = (viscosity * mass[j] / density[j]) * (h - dist) * spiky;
+                f[0] += pressureScale * rx + viscosityScale * (vx[j] - vx[i]);
+                f[1] += pressureScale * ry + viscosityScale * (vy[j] - vy[i]);
+                f[2] += pressureScale * rz + viscosityScale * (vz[j] - vz[i]);
+            });
+            fx[i] = f[0];
+            fy[i] = f[1];
+            fz[i] = f[2];
+        });
     }
+
     /// update particle positions
-    for (auto pi : particles){
-        Particle *p = particles[i];
-        p->acceleration = p->force / p->density + Vec3(0.f, -9.8f, 0.f);
-        p->velocity += p->force / p->density * dt;
-        p->position += p->velocity * dt;
+    HINAPE_PROFILE_ZONE("sph.integrate");
+    float *px = particles.x.data(), *py = particles.y.data(), *pz = particles.z.data();
+    float *pvx = particles.vx.data(), *pvy = particles.vy.data(), *pvz = particles.vz.data();
+    for (unsigned int i = 0; i < n; i++)
+    {
+        float inv_density = 1.0f / density[i];
+        pvx[i] += fx[i] * inv_density * dt;
+        pvy[i] += (fy[i] * inv_density - 9.8f) * dt;
+        pvz[i] += fz[i] * inv_density * dt;
+        px[i] += pvx[i] * dt;
+        py[i] += pvy[i] * dt;
+        pz[i] += pvz[i] * dt;
     }
 }
 
@@ -4,9 +4,10 @@
 #include "../../common.h"
 
 #include "../../util/lib/frame.h"
+#include "../../util/lib/point3.h"
 #include "../../physics_objects/particle_system_data3.h"
 #include "../../physics_objects/particle_emitter3.h"
-#include "../../physics_objects/particle_system.h"
+#include "../../physics_objects/particle_buffer.h"
 
 namespace HinaPE
 {
@@ -16,6 +17,9 @@ class SPHKernel
 {
 public:
     auto simulate(float dt) -> void;
+    auto stable_dt(float cfl) const -> float; // largest step moving no particle farther than cfl times the kernel radius
+    auto save(SnapshotWriter &out) const -> void; // the particles, the grid is rebuilt every step
+    auto load(SnapshotReader &in) -> void;
 
     struct Opt
     {
@@ -26,16 +30,34 @@ public:
 
     };
     Opt opt;
-    float h, MASS, self_density, eosScale, eosExponent;
-    float targetDensity;
-    std::vector<Particle*> particles;
-    Particle ** particleTable;
+    // water with a particle spacing of 0.05, h = 2 spacing and MASS = targetDensity spacing^3;
+    // self_density is the poly6 contribution of a particle to itself, recompute it when h or MASS change
+    float h = 0.1f;
+    float MASS = 0.125f;
+    float self_density = 195.93f;
+    float eosScale = 1000.f;
+    float eosExponent = 7.f;
+    float viscosity = 0.01f;
+    float targetDensity = 1000.f;
+    ParticleBuffer particles; // reordered by cell in every buildTable()
+
+    // Uniform grid built by counting sort: particles of hash bucket b are [cell_start[b], cell_start[b + 1]) of the buffer.
+    // The bucket count follows the particle count. Colliding cells share a bucket, so a neighbour search scans every
+    // bucket once and leaves the particles of other cells to the distance test.
+    struct CellGrid
+    {
+        std::vector<unsigned int> cell_start;
+        std::vector<unsigned int> particle_bucket;
+        std::vector<unsigned int> order;
+    };
+    CellGrid grid;
 
 public:
     auto init_particle_system() -> void;
-    auto buildTable() ->void;
-    static auto getHash(Vec3 cell) -> unsigned int;
-    auto getCell(Particle* p) const -> Vec3;
+    auto add_particle(const Vec3 &position, const Vec3 &velocity = Vec3()) -> unsigned int; // with mass MASS, return its id
+    auto buildTable() -> void;
+    auto getHash(const Point<int, 3> &cell) const -> unsigned int;
+    auto getCell(float x, float y, float z) const -> Point<int, 3>;
 //    float cubic_kernel(float r_norm);
 //    float cubic_kernel_derivative(float r_norm);
 
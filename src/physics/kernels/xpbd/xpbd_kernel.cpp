@@ -1,7 +1,266 @@
 #include "xpbd_kernel.h"
 #include "../../physics_system.h"
+#include "../../util/parallel_lib/parallel_for.h"
+#include "../../util/simd_integrate.h"
+#include "../../util/profiler.h"
+
+#include <algorithm>
+#include <limits>
+
+HinaPE::XPBDKernel::XPBDKernel(HinaPE::PhysicsSystem &sys) : physics_system(sys) {}
 
 void HinaPE::XPBDKernel::simulate(float dt)
 {
+    HINAPE_PROFILE_ZONE("xpbd.simulate");
+    std::erase_if(bodies, [&](const auto &pair) { return !physics_system.contains(pair.first); });
+
+    const int substeps = std::max(opt.substeps, 1);
+    const float h = dt / (float) substeps;
+    self_collision_stats = {};
+    if (opt.continuous_collision)
+        physics_system.ccd.update();
+    auto run = [&](auto &e)
+    {
+        auto &body = bodies[e.id];
+        {
+            HINAPE_PROFILE_ZONE("xpbd.init");
+            init(*e.body, body);
+        }
+        for (int s = 0; s < substeps; ++s)
+            substep(*e.body, body, h);
+    };
+    for (auto &e: physics_system.objects<DeformableBase<CLOTH>>())
+        run(e);
+    for (auto &e: physics_system.objects<DeformableBase<MESH>>())
+        run(e);
+}
+
+auto HinaPE::XPBDKernel::save(SnapshotWriter &out) const -> void
+{
+    out.value(bodies.size());
+    for (auto &[id, body]: bodies)
+    {
+        out.value(id);
+        for (auto *lambda: {&body.distance.lambda, &body.bending.lambda, &body.volume.lambda, &body.attachment.lambda})
+            out.array(*lambda);
+    }
+}
+
+auto HinaPE::XPBDKernel::load(SnapshotReader &in) -> void
+{
+    auto n = in.value<size_t>();
+    std::vector<float> skipped;
+    for (size_t k = 0; k < n; ++k)
+    {
+        auto it = bodies.find(in.value<unsigned int>());
+        if (it == bodies.end())
+        {
+            for (int batch = 0; batch < 4; ++batch)
+                in.array(skipped); // the body was dropped since
+            continue;
+        }
+        auto &body = it->second;
+        for (auto *lambda: {&body.distance.lambda, &body.bending.lambda, &body.volume.lambda, &body.attachment.lambda})
+            in.array(*lambda);
+    }
+    for (auto &[id, body]: bodies)
+        body.self_collision.invalidate();
+}
+
+auto HinaPE::XPBDKernel::stable_dt(float cfl) const -> float
+{
+    float speed = 0;
+    for (auto &e: physics_system.objects<DeformableBase<CLOTH>>())
+        speed = std::max(speed, e.body->velocities().max_norm());
+    for (auto &e: physics_system.objects<DeformableBase<MESH>>())
+        speed = std::max(speed, e.body->velocities().max_norm());
+    return speed > 0 ? (float) std::max(opt.substeps, 1) * cfl * opt.self_collision_opt.thickness / speed : std::numeric_limits<float>::infinity();
+}
+
+auto HinaPE::XPBDKernel::self_collision_counters() const -> const ClothSelfCollision::Counters &
+{
+    return self_collision_stats;
+}
+
+template<HinaPE::DeformableType Type>
+void HinaPE::XPBDKernel::init(DeformableBase<Type> &deformable, Body &body)
+{
+    auto &edges = deformable.edges();
+    auto &indices = deformable.indices();
+    if (body.edges == edges && body.indices == indices && !body.w.empty())
+        return;
+
+    // topology changed: the current shape becomes the rest state
+    auto &x = deformable.vertices();
+    auto &masses = deformable.masses();
+    auto &inv_masses = deformable.inv_masses();
+    const auto n = static_cast<unsigned int>(x.size());
+
+    body = Body{};
+    body.edges = edges;
+    body.indices = indices;
+    body.w.resize(n);
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        body.w[i] = inv_masses[i] > 0 ? inv_masses[i] : (masses[i] > 0 ? 1.f / masses[i] : 0.f);
+        if (inv_masses[i] == 0)
+        {
+            body.attachment.i.push_back(i);
+            body.attachment.target.push_back(x.get(i));
+        }
+    }
+    body.attachment.lambda.assign(body.attachment.i.size(), 0);
+
+    auto add_distance = [&](DistanceBatch &batch, unsigned int a, unsigned int b)
+    {
+        batch.i.push_back(a);
+        batch.j.push_back(b);
+        batch.rest.push_back((x.get(a) - x.get(b)).norm());
+    };
+    for (auto &e: edges)
+        add_distance(body.distance, e.first, e.second);
+
+    // bending: distance between the two vertices opposite to an interior edge
+    std::map<std::pair<int, int>, int> opposite;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        for (int k = 0; k < 3; ++k)
+        {
+            int a = indices[t + k], b = indices[t + (k + 1) % 3], c = indices[t + (k + 2) % 3];
+            auto key = std::minmax(a, b);
+            auto it = opposite.find(key);
+            if (it == opposite.end())
+                opposite.emplace(key, c);
+            else if (it->second != c)
+                add_distance(body.bending, it->second, c);
+        }
+
+    for (auto *batch: {&body.distance, &body.bending})
+    {
+        batch->lambda.assign(batch->rest.size(), 0);
+        batch->coloring.build(static_cast<unsigned int>(batch->rest.size()), n, [&](unsigned int c, auto &&func)
+        {
+            func(batch->i[c]);
+            func(batch->j[c]);
+        });
+    }
+
+    if constexpr (Type == CLOTH)
+        body.self_collision.set_topology(x, indices, edges);
+    if constexpr (Type == MESH)
+    {
+        float volume = 0;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            volume += dot(cross(x.get(indices[t]), x.get(indices[t + 1])), x.get(indices[t + 2])) / 6.f;
+        body.volume.rest.push_back(volume);
+        body.volume.lambda.push_back(0);
+    }
+}
+
+template<HinaPE::DeformableType Type>
+void HinaPE::XPBDKernel::substep(DeformableBase<Type> &deformable, Body &body, float h)
+{
+    auto &x = deformable.vertices();
+    auto &v = deformable.velocities();
+    auto &inv_masses = deformable.inv_masses();
+
+    // predict
+    {
+        HINAPE_PROFILE_ZONE("xpbd.predict");
+        body.prev = x;
+        integrate(x, v, inv_masses, opt.gravity, h);
+    }
+
+    // a single iteration, multipliers start from zero every substep
+    {
+        HINAPE_PROFILE_ZONE("xpbd.constraints");
+        const float h2 = h * h;
+        for (auto *lambda: {&body.distance.lambda, &body.bending.lambda, &body.volume.lambda, &body.attachment.lambda})
+            std::fill(lambda->begin(), lambda->end(), 0.f);
+        solve_distance(body.distance, x, body.w, opt.distance_compliance / h2);
+        solve_distance(body.bending, x, body.w, opt.bending_compliance / h2);
+        solve_volume(body, x, opt.volume_compliance / h2);
+        solve_attachment(body.attachment, x, body.w, opt.attachment_compliance / h2);
+    }
+    if constexpr (Type == CLOTH)
+    {
+        if (opt.self_collision)
+        {
+            body.self_collision.opt = opt.self_collision_opt;
+            body.self_collision.solve(x, inv_masses);
+            self_collision_stats += body.self_collision.counters();
+        }
+        if (opt.continuous_collision)
+            physics_system.ccd.solve(body.prev, x, inv_masses, body.edges);
+    }
+
+    HINAPE_PROFILE_ZONE("xpbd.velocities");
+    update_velocities(v, x, body.prev, h);
+}
+
+void HinaPE::XPBDKernel::solve_distance(DistanceBatch &batch, Vec3Stream &x, const std::vector<float> &w, float alpha)
+{
+    auto solve = [&](unsigned int c)
+    {
+        auto a = batch.i[c], b = batch.j[c];
+        float wsum = w[a] + w[b];
+        Vec3 d = x.get(a) - x.get(b);
+        float len = d.norm();
+        if (wsum + alpha <= 0 || len <= 0)
+            return;
+        Vec3 grad = d / len;
+        float C = len - batch.rest[c];
+        float dlambda = (-C - alpha * batch.lambda[c]) / (wsum + alpha);
+        batch.lambda[c] += dlambda;
+        x.add(a, grad * (dlambda * w[a]));
+        x.add(b, grad * (-dlambda * w[b]));
+    };
+    for (auto &colored: batch.coloring.batches)
+        parallel_for(static_cast<size_t>(0), colored.size(), [&](size_t k) { solve(colored[k]); });
+    for (auto c: batch.coloring.conflicts)
+        solve(c);
+}
+
+void HinaPE::XPBDKernel::solve_volume(Body &body, Vec3Stream &x, float alpha)
+{
+    if (body.volume.rest.empty())
+        return;
+    auto &indices = body.indices;
+    auto &grads = body.volume.gradients;
+    grads.assign(x.size(), Vec3(0.f));
+
+    float volume = 0;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        Vec3 p0 = x.get(indices[t]), p1 = x.get(indices[t + 1]), p2 = x.get(indices[t + 2]);
+        volume += dot(cross(p0, p1), p2) / 6.f;
+        grads[indices[t]] += cross(p1, p2) / 6.f;
+        grads[indices[t + 1]] += cross(p2, p0) / 6.f;
+        grads[indices[t + 2]] += cross(p0, p1) / 6.f;
+    }
 
+    float denominator = alpha;
+    for (size_t i = 0; i < x.size(); ++i)
+        denominator += body.w[i] * grads[i].norm_squared();
+    if (denominator <= 0)
+        return;
+    float C = volume - body.volume.rest[0];
+    float dlambda = (-C - alpha * body.volume.lambda[0]) / denominator;
+    body.volume.lambda[0] += dlambda;
+    parallel_for(static_cast<size_t>(0), x.size(), [&](size_t i) { x.add(i, grads[i] * (dlambda * body.w[i])); });
+}
+
+void HinaPE::XPBDKernel::solve_attachment(AttachmentBatch &batch, Vec3Stream &x, const std::vector<float> &w, float alpha)
+{
+    // every attachment touches a single particle, no coloring needed
+    parallel_for(static_cast<size_t>(0), batch.i.size(), [&](size_t c)
+    {
+        auto a = batch.i[c];
+        Vec3 d = x.get(a) - batch.target[c];
+        float len = d.norm();
+        if (w[a] + alpha <= 0 || len <= 0)
+            return;
+        float dlambda = (-len - alpha * batch.lambda[c]) / (w[a] + alpha);
+        batch.lambda[c] += dlambda;
+        x.add(a, d / len * (dlambda * w[a]));
+    });
 }
@@ -1,14 +1,93 @@
 #ifndef HINAPE_XPBD_KERNEL_H
 #define HINAPE_XPBD_KERNEL_H
 
+#include "../../common.h"
+#include "../../physics_objects/deformable.h"
+#include "../../util/graph_coloring.h"
+#include "../../util/snapshot.h"
+#include "../collision/cloth_self_collision.h"
+
+#include <map>
+#include <vector>
+
 namespace HinaPE
 {
 class PhysicsSystem;
 
+// Small steps XPBD (Macklin et al. 2019): many substeps per frame, a single constraint iteration per substep.
 class XPBDKernel final
 {
 public:
     void simulate(float dt);
+
+    struct Opt
+    {
+        int substeps = 20;
+        Vec3 gravity = Vec3(0.f, -9.8f, 0.f);
+        // compliances (inverse stiffness), 0 is infinitely stiff
+        float distance_compliance = 0.f;
+        float bending_compliance = 1e-3f;
+        float volume_compliance = 0.f; // closed meshes only
+        float attachment_compliance = 0.f; // vertices created with zero inverse mass are attached to their initial position
+        bool self_collision = true; // cloths only, once per substep
+        ClothSelfCollision::Opt self_collision_opt;
+        bool continuous_collision = true; // cloths against the static colliders of PhysicsSystem::ccd, once per substep
+    };
+    Opt opt;
+
+    auto stable_dt(float cfl) const -> float; // largest step moving no particle farther than cfl times the self-collision thickness per substep, infinity if unbounded
+    auto self_collision_counters() const -> const ClothSelfCollision::Counters &; // summed over all cloths and substeps of the last step
+    auto save(SnapshotWriter &out) const -> void; // the Lagrange multipliers of the last substep
+    auto load(SnapshotReader &in) -> void;
+
+public:
+    explicit XPBDKernel(PhysicsSystem &sys);
+
+private:
+    // constraints are stored by type in structure-of-arrays batches, with their Lagrange multipliers in flat arrays
+    struct DistanceBatch // distance between two particles, also used for bending across the shared edge of two triangles
+    {
+        std::vector<unsigned int> i, j;
+        std::vector<float> rest;
+        std::vector<float> lambda;
+        ConstraintColoring coloring;
+    };
+    struct VolumeBatch // volume enclosed by a closed triangle mesh
+    {
+        std::vector<float> rest; // one entry per body (0 or 1 here)
+        std::vector<float> lambda;
+        std::vector<Vec3> gradients; // scratch
+    };
+    struct AttachmentBatch // pin a particle to a world position
+    {
+        std::vector<unsigned int> i;
+        std::vector<Vec3> target;
+        std::vector<float> lambda;
+    };
+    struct Body
+    {
+        DistanceBatch distance, bending;
+        VolumeBatch volume;
+        AttachmentBatch attachment;
+        std::vector<float> w; // inverse masses seen by the solver, attached particles use their real mass
+        Vec3Stream prev;
+        std::vector<std::pair<int, int>> edges; // topology the constraints were built for
+        std::vector<int> indices;
+        ClothSelfCollision self_collision;
+    };
+
+    template<DeformableType Type>
+    void init(DeformableBase<Type> &, Body &);
+    template<DeformableType Type>
+    void substep(DeformableBase<Type> &, Body &, float h);
+    void solve_distance(DistanceBatch &, Vec3Stream &x, const std::vector<float> &w, float alpha);
+    void solve_volume(Body &, Vec3Stream &x, float alpha);
+    void solve_attachment(AttachmentBatch &, Vec3Stream &x, const std::vector<float> &w, float alpha);
+
+private:
+    PhysicsSystem &physics_system;
+    std::map<unsigned int, Body> bodies;
+    ClothSelfCollision::Counters self_collision_stats;
 };
 
 }
@@ -18,7 +18,7 @@ auto HinaPE::PhysicsObject::get_rotation() const -> Vec3
                       }, physics_object_opt.value());
 }
 
-auto HinaPE::PhysicsObject::get_vertices() -> std::vector<Vec3> &
+auto HinaPE::PhysicsObject::get_vertices() -> HinaPE::Vec3Stream &
 {
     switch (physics_object_opt.value().index())
     {
@@ -68,6 +68,11 @@ auto HinaPE::PhysicsObject::set_rotation(const Vec3 &r) const -> void
                }, physics_object_opt.value());
 }
 
+auto HinaPE::PhysicsObject::get_body_index() const -> int
+{
+    return physics_object_opt.has_value() ? static_cast<int>(physics_object_opt->index()) : -1;
+}
+
 auto HinaPE::PhysicsObject::switch_rigidbody_type(HinaPE::RigidBodyType to) -> void
 {
     if (physics_object_opt == std::nullopt)
@@ -179,7 +184,7 @@ auto HinaPE::PhysicsObject::get_deformable_type() const -> HinaPE::DeformableTyp
     }
 }
 
-auto HinaPE::PhysicsObject::get_velocities() -> std::vector<Vec3> &
+auto HinaPE::PhysicsObject::get_velocities() -> HinaPE::Vec3Stream &
 {
     switch (physics_object_opt.value().index())
     {
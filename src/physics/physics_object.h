@@ -23,10 +23,11 @@ public:
     // universal methods
     auto get_position() const -> Vec3;
     auto get_rotation() const -> Vec3;
-    auto get_vertices() -> std::vector<Vec3> &;
+    auto get_vertices() -> Vec3Stream &;
     auto get_indices() -> std::vector<int> &;
     auto set_position(const Vec3 &) const -> void;
     auto set_rotation(const Vec3 &) const -> void;
+    auto get_body_index() const -> int; // index of the held body in the variant below, -1 if none
 
     // rigidbody methods
     auto is_rigidbody() -> bool;
@@ -36,7 +37,7 @@ public:
     // deformable methods
     auto is_deformable() -> bool;
     auto get_deformable_type() const -> DeformableType;
-    auto get_velocities() -> std::vector<Vec3> &;
+    auto get_velocities() -> Vec3Stream &;
     auto get_masses() -> std::vector<float> &;
     auto get_inv_masses() -> std::vector<float> &;
 
@@ -2,6 +2,8 @@
 #define HINAPE_DEFORMABLE_H
 
 #include "../common.h"
+#include "../util/vec3_stream.h"
+#include "../util/snapshot.h"
 
 #include <memory>
 #include <type_traits>
@@ -17,16 +19,20 @@ public:
     auto set_position(const Vec3 &) const -> void;
     auto set_rotation(const Vec3 &) const -> void;
 
-    auto vertices() -> std::vector<Vec3> &;
-    auto velocities() -> std::vector<Vec3> &;
+    auto vertices() -> Vec3Stream &;
+    auto velocities() -> Vec3Stream &;
     auto masses() -> std::vector<float> &;
     auto inv_masses() -> std::vector<float> &;
     auto indices() -> std::vector<int> &;
     auto edges() -> std::vector<std::pair<int, int>> &;
+    auto stiffness() -> float &;
 
     auto setup_geometry() -> void;
     auto check_valid() -> bool;
 
+    auto save(SnapshotWriter &out) const -> void; // transform, particles and masses (not the topology), for checkpoints
+    auto load(SnapshotReader &in) -> void;
+
 public:
     DeformableBase();
     ~DeformableBase();
@@ -15,15 +15,15 @@ struct DeformableBase<Type>::Impl
     Quat q; // orientation
     Vec3 s; // scale
 
-    // Deformable particles (proxy in the future)
-    std::vector<Vec3> positions;
-    std::vector<Vec3> velocities;
+    // Deformable particles (proxy in the future), positions and velocities as aligned x/y/z streams
+    Vec3Stream positions;
+    Vec3Stream velocities;
     std::vector<float> masses;
     std::vector<float> inv_masses;
 
     std::vector<int> indices;
     std::vector<std::pair<int, int>> edges;
-    float stiffness;
+    float stiffness = 1.f;
 
     Impl() = default;
     ~Impl() = default;
@@ -46,10 +46,10 @@ template<DeformableType Type>
 void HinaPE::DeformableBase<Type>::set_rotation(const Vec3 &_r) const { /** TODO: implement **/}
 
 template<DeformableType Type>
-auto DeformableBase<Type>::vertices() -> std::vector<Vec3> & { return impl->positions; }
+auto DeformableBase<Type>::vertices() -> Vec3Stream & { return impl->positions; }
 
 template<DeformableType Type>
-auto DeformableBase<Type>::velocities() -> std::vector<Vec3> & { return impl->velocities; }
+auto DeformableBase<Type>::velocities() -> Vec3Stream & { return impl->velocities; }
 
 template<DeformableType Type>
 auto DeformableBase<Type>::masses() -> std::vector<float> & { return impl->masses; }
@@ -63,6 +63,9 @@ auto DeformableBase<Type>::indices() -> std::vector<int> & { return impl->indice
 template<DeformableType Type>
 auto DeformableBase<Type>::edges() -> std::vector<std::pair<int, int>> & { return impl->edges; }
 
+template<DeformableType Type>
+auto DeformableBase<Type>::stiffness() -> float & { return impl->stiffness; }
+
 template<DeformableType Type>
 auto DeformableBase<Type>::setup_geometry() -> void
 {
@@ -72,7 +75,7 @@ auto DeformableBase<Type>::setup_geometry() -> void
     auto size = inds.size();
     assert(size % 3 == 0); // make sure is triangle geom mesh
 
-    Eigen::Map<Eigen::MatrixXi> M_inds(inds.data(), size / 3, 3);
+    Eigen::Map<Eigen::Matrix<int, Eigen::Dynamic, 3, Eigen::RowMajor>> M_inds(inds.data(), static_cast<Eigen::Index>(size / 3), 3); // one triangle per row
     Eigen::MatrixXi E;
     igl::edges(M_inds, E);
 
@@ -82,6 +85,32 @@ auto DeformableBase<Type>::setup_geometry() -> void
         _edges[i] = std::make_pair(E(i, 0), E(i, 1));
 }
 
+template<DeformableType Type>
+auto DeformableBase<Type>::save(SnapshotWriter &out) const -> void
+{
+    out.value(impl->p);
+    out.value(impl->q);
+    out.value(impl->s);
+    out.stream(impl->positions);
+    out.stream(impl->velocities);
+    out.array(impl->masses);
+    out.array(impl->inv_masses);
+    out.value(impl->stiffness);
+}
+
+template<DeformableType Type>
+auto DeformableBase<Type>::load(SnapshotReader &in) -> void
+{
+    in.value(impl->p);
+    in.value(impl->q);
+    in.value(impl->s);
+    in.stream(impl->positions);
+    in.stream(impl->velocities);
+    in.array(impl->masses);
+    in.array(impl->inv_masses);
+    in.value(impl->stiffness);
+}
+
 template<DeformableType Type>
 auto DeformableBase<Type>::check_valid() -> bool
 {
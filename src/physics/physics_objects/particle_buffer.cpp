@@ -0,0 +1,114 @@
+#include "particle_buffer.h"
+
+#include <algorithm>
+#include <cassert>
+
+auto HinaPE::ParticleBuffer::add(float m, const Vec3 &position, const Vec3 &velocity) -> unsigned int
+{
+    x.push_back(position.x);
+    y.push_back(position.y);
+    z.push_back(position.z);
+    vx.push_back(velocity.x);
+    vy.push_back(velocity.y);
+    vz.push_back(velocity.z);
+    fx.push_back(0);
+    fy.push_back(0);
+    fz.push_back(0);
+    mass.push_back(m);
+    density.push_back(0);
+    pressure.push_back(0);
+    id.push_back(next_id);
+    return next_id++;
+}
+
+auto HinaPE::ParticleBuffer::remove(size_t i) -> void
+{
+    assert(i < size());
+    removed.push_back(static_cast<unsigned int>(i));
+}
+
+auto HinaPE::ParticleBuffer::compact() -> void
+{
+    if (removed.empty())
+        return;
+    std::sort(removed.begin(), removed.end());
+    removed.erase(std::unique(removed.begin(), removed.end()), removed.end());
+
+    auto squeeze = [&](auto &s)
+    {
+        size_t dst = removed.front();
+        for (size_t k = 0; k < removed.size(); ++k)
+        {
+            size_t next = k + 1 < removed.size() ? removed[k + 1] : s.size();
+            for (size_t src = removed[k] + 1; src < next; ++src)
+                s[dst++] = s[src];
+        }
+        s.resize(dst);
+    };
+    for_each_stream(squeeze);
+    squeeze(id);
+    removed.clear();
+}
+
+auto HinaPE::ParticleBuffer::reorder(const std::vector<unsigned int> &order) -> void
+{
+    assert(order.size() == size());
+    assert(removed.empty()); // removed indices would be invalidated, compact() first
+    const size_t n = order.size();
+    for_each_stream([&](Stream &s)
+                    {
+                        scratch.resize(n);
+                        for (size_t i = 0; i < n; ++i)
+                            scratch[i] = s[order[i]];
+                        s.swap(scratch);
+                    });
+    scratch_id.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        scratch_id[i] = id[order[i]];
+    id.swap(scratch_id);
+}
+
+auto HinaPE::ParticleBuffer::reserve(size_t n) -> void
+{
+    for_each_stream([&](Stream &s) { s.reserve(n); });
+    id.reserve(n);
+}
+
+auto HinaPE::ParticleBuffer::clear() -> void
+{
+    for_each_stream([](Stream &s) { s.clear(); });
+    id.clear();
+    removed.clear();
+}
+
+auto HinaPE::ParticleBuffer::save(SnapshotWriter &out) const -> void
+{
+    for (auto *s: {&x, &y, &z, &vx, &vy, &vz, &fx, &fy, &fz, &mass, &density, &pressure})
+        out.array(*s);
+    out.array(id);
+    out.array(removed);
+    out.value(next_id);
+}
+
+auto HinaPE::ParticleBuffer::load(SnapshotReader &in) -> void
+{
+    for_each_stream([&](Stream &s) { in.array(s); });
+    in.array(id);
+    in.array(removed);
+    in.value(next_id);
+}
+
+auto HinaPE::ParticleBuffer::size() const -> size_t
+{
+    return x.size();
+}
+
+auto HinaPE::ParticleBuffer::position(size_t i) const -> Vec3
+{
+    return Vec3(x[i], y[i], z[i]);
+}
+
+auto HinaPE::ParticleBuffer::velocity(size_t i) const -> Vec3
+{
+    return Vec3(vx[i], vy[i], vz[i]);
+}
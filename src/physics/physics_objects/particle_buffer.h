@@ -0,0 +1,53 @@
+#ifndef HINAPE_PARTICLE_BUFFER_H
+#define HINAPE_PARTICLE_BUFFER_H
+
+#include "../common.h"
+#include "../util/aligned_allocator.h"
+#include "../util/snapshot.h"
+
+#include <vector>
+
+namespace HinaPE
+{
+// Structure-of-arrays particle storage: one 64-byte aligned float stream per attribute,
+// so a pass only streams the attributes it reads and its loops can be vectorised.
+class ParticleBuffer
+{
+public:
+    using Stream = AlignedVector<float>;
+
+    Stream x, y, z;
+    Stream vx, vy, vz;
+    Stream fx, fy, fz;
+    Stream mass, density, pressure;
+    AlignedVector<unsigned int> id; // stable id, follows the particle through reorder() and compact()
+
+public:
+    auto add(float m, const Vec3 &position, const Vec3 &velocity = Vec3()) -> unsigned int; // return the new particle's id
+    auto remove(size_t i) -> void; // particle i stays in the streams until the next compact()
+    auto compact() -> void; // drop removed particles, alive particles keep their relative order
+    auto reorder(const std::vector<unsigned int> &order) -> void; // the new i-th particle is the old order[i]-th
+    auto reserve(size_t n) -> void;
+    auto clear() -> void;
+    auto size() const -> size_t;
+    auto position(size_t i) const -> Vec3;
+    auto velocity(size_t i) const -> Vec3;
+    auto save(SnapshotWriter &out) const -> void; // every stream and the id bookkeeping, for checkpoints
+    auto load(SnapshotReader &in) -> void;
+
+private:
+    template<typename Func>
+    auto for_each_stream(Func &&func) -> void
+    {
+        for (auto *s: {&x, &y, &z, &vx, &vy, &vz, &fx, &fy, &fz, &mass, &density, &pressure})
+            func(*s);
+    }
+
+    std::vector<unsigned int> removed;
+    Stream scratch;
+    AlignedVector<unsigned int> scratch_id;
+    unsigned int next_id = 0;
+};
+}
+
+#endif //HINAPE_PARTICLE_BUFFER_H
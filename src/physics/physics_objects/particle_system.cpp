@@ -17,8 +17,6 @@ Particle::Particle(float mass, float size, Vec3 position, Vec3 velocity) {
     density = 0.0f;
     pressure = 0.0f;
     id = count++;
-
-    next = NULL;
 }
 
 Particle::~Particle() {
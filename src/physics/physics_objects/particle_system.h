@@ -16,7 +16,6 @@ public:
 
     Vec3 position, velocity, acceleration;
     Vec3 force;
-    Particle* next;
 
     Particle(float mass, float size, Vec3 position, Vec3 velocity);
     ~Particle();
@@ -2,6 +2,7 @@
 #define HINAPE_RIGIDBODY_H
 
 #include "../common.h"
+#include "../util/snapshot.h"
 
 #include <memory>
 #include <type_traits>
@@ -46,6 +47,14 @@ public:
     template<RigidBodyType T = Type, typename = typename std::enable_if<T == DYNAMIC>::type>
     auto set_angular_damping(float d) const-> void;
 
+    template<RigidBodyType T = Type, typename = typename std::enable_if<T == DYNAMIC>::type>
+    auto is_sleeping() const -> bool;
+    template<RigidBodyType T = Type, typename = typename std::enable_if<T == DYNAMIC>::type>
+    auto wake_up() const -> void; // add_force and setting a velocity wake the body too
+
+    auto save(SnapshotWriter &out) const -> void; // the whole state, for checkpoints
+    auto load(SnapshotReader &in) -> void;
+
 public:
     RigidBodyBase();
     ~RigidBodyBase();
@@ -61,6 +70,7 @@ private:
     friend void copy_impl(typename RigidBodyBase<FromType>::Impl *from, typename RigidBodyBase<ResType>::Impl *res);
 
     friend class RigidBodyFactory;
+    friend class RigidBodySolver;
     struct Impl;
     std::unique_ptr<Impl> impl;
 };
@@ -21,6 +21,11 @@ struct RigidBodyBase<Type>::Impl
     Vec3 t; // torque
     Vec3 a; // acceleration
 
+    // Sleeping
+    bool sleeping = false;
+    int still_frames = 0; // consecutive steps spent under the sleep thresholds
+    unsigned int sleep_group = 0; // island the body fell asleep with, 0: none
+
     Impl() = default;
     ~Impl() = default;
     Impl(const Impl &src) = delete;
@@ -44,11 +49,44 @@ auto copy_impl(typename RigidBodyBase<FromType>::Impl *from, typename RigidBodyB
     res->f = from->f;
     res->t = from->t;
     res->a = from->a;
+    res->sleeping = from->sleeping;
+    res->still_frames = from->still_frames;
+    res->sleep_group = from->sleep_group;
+}
+
+template<RigidBodyType Type>
+auto RigidBodyBase<Type>::save(SnapshotWriter &out) const -> void
+{
+    for (auto *v: {&impl->p, &impl->s, &impl->v, &impl->w, &impl->f, &impl->t, &impl->a})
+        out.value(*v);
+    out.value(impl->q);
+    for (auto *v: {&impl->m, &impl->im, &impl->ld, &impl->ad})
+        out.value(*v);
+    out.value(impl->sleeping);
+    out.value(impl->still_frames);
+    out.value(impl->sleep_group);
+}
+
+template<RigidBodyType Type>
+auto RigidBodyBase<Type>::load(SnapshotReader &in) -> void
+{
+    for (auto *v: {&impl->p, &impl->s, &impl->v, &impl->w, &impl->f, &impl->t, &impl->a})
+        in.value(*v);
+    in.value(impl->q);
+    for (auto *v: {&impl->m, &impl->im, &impl->ld, &impl->ad})
+        in.value(*v);
+    in.value(impl->sleeping);
+    in.value(impl->still_frames);
+    in.value(impl->sleep_group);
 }
 
 template<RigidBodyType Type>
 template<RigidBodyType T, typename>
-auto RigidBodyBase<Type>::add_force(const Vec3 &f) const -> void{ impl->f += f; }
+auto RigidBodyBase<Type>::add_force(const Vec3 &f) const -> void
+{
+    impl->f += f;
+    wake_up();
+}
 
 template<RigidBodyType Type>
 template<RigidBodyType T, typename>
@@ -56,15 +94,23 @@ auto RigidBodyBase<Type>::add_acceleration(const Vec3 &a) const -> void{ impl->a
 
 template<RigidBodyType Type>
 template<RigidBodyType T, typename>
-auto RigidBodyBase<Type>::set_linear_velocity(const Vec3 &v) const -> void{ impl->v = v; }
+auto RigidBodyBase<Type>::set_linear_velocity(const Vec3 &v) const -> void
+{
+    impl->v = v;
+    wake_up();
+}
 
 template<RigidBodyType Type>
 template<RigidBodyType T, typename>
-auto RigidBodyBase<Type>::set_angular_velocity(const Vec3 &w) const -> void{ impl->w = w; }
+auto RigidBodyBase<Type>::set_angular_velocity(const Vec3 &w) const -> void
+{
+    impl->w = w;
+    wake_up();
+}
 
 template<RigidBodyType Type>
 template<RigidBodyType T, typename>
-auto RigidBodyBase<Type>::set_linear_damping(float d) const -> void{ impl->d = d; }
+auto RigidBodyBase<Type>::set_linear_damping(float d) const -> void{ impl->ld = d; }
 
 template<RigidBodyType Type>
 template<RigidBodyType T, typename>
@@ -72,7 +118,11 @@ auto RigidBodyBase<Type>::set_angular_damping(float d) const -> void{ impl->ad =
 
 template<RigidBodyType Type>
 template<RigidBodyType T, typename>
-auto RigidBodyBase<Type>::set_mass(float m) const -> void{ impl->m = m; }
+auto RigidBodyBase<Type>::set_mass(float m) const -> void
+{
+    impl->m = m;
+    impl->im = m > 0 ? 1.f / m : 0.f;
+}
 
 template<RigidBodyType Type>
 template<RigidBodyType T, typename>
@@ -98,6 +148,18 @@ template<RigidBodyType Type>
 template<RigidBodyType T, typename>
 auto RigidBodyBase<Type>::get_force() const -> Vec3 { return impl->f; }
 
+template<RigidBodyType Type>
+template<RigidBodyType T, typename>
+auto RigidBodyBase<Type>::is_sleeping() const -> bool { return impl->sleeping; }
+
+template<RigidBodyType Type>
+template<RigidBodyType T, typename>
+auto RigidBodyBase<Type>::wake_up() const -> void
+{
+    impl->sleeping = false;
+    impl->still_frames = 0;
+}
+
 template<RigidBodyType Type>
 auto RigidBodyBase<Type>::get_position() const -> Vec3 { return impl->p; }
 
@@ -0,0 +1,28 @@
+#ifndef HINAPE_PHYSICS_STATE_H
+#define HINAPE_PHYSICS_STATE_H
+
+#include "common.h"
+
+#include <map>
+#include <vector>
+
+namespace HinaPE
+{
+// renderer-facing copy of one physics object after a completed step
+struct ObjectState
+{
+    Vec3 position;
+    Vec3 rotation;
+    std::vector<Vec3> vertices; // deformable only
+};
+
+// renderer-facing copy of the whole system after a completed step
+struct PhysicsState
+{
+    unsigned long long frame = 0;
+    double time = 0.0;
+    std::map<unsigned int, ObjectState> objects;
+};
+}
+
+#endif //HINAPE_PHYSICS_STATE_H
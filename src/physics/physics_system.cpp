@@ -1,11 +1,54 @@
 #include "physics_system.h"
+#include "util/profiler.h"
+#include "util/parallel_lib/parallel_for.h"
 
 #include <utility>
+#include <algorithm>
+#include <type_traits>
 #include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <array>
+
+namespace
+{
+// FNV-1a on 32-bit words: floats are hashed by their bit pattern, so -0 and 0 (or two NaNs) differ as they should
+struct StateHasher
+{
+    std::uint64_t h = 14695981039346656037ull;
+
+    auto add(std::uint32_t word) -> void
+    {
+        h ^= word;
+        h *= 1099511628211ull;
+    }
+    auto add(float f) -> void
+    {
+        std::uint32_t word;
+        std::memcpy(&word, &f, sizeof(word));
+        add(word);
+    }
+    auto add(const Vec3 &v) -> void
+    {
+        add(v.x);
+        add(v.y);
+        add(v.z);
+    }
+    template<typename Stream>
+    auto add_stream(const Stream &s) -> void
+    {
+        add(static_cast<std::uint32_t>(s.size()));
+        for (auto v: s)
+            add(v);
+    }
+};
+}
 
 auto HinaPE::PhysicsSystem::_start_() -> void
 {
     running = true;
+    control_cv.notify_one();
 }
 
 auto HinaPE::PhysicsSystem::_pause_() -> void
@@ -15,10 +58,250 @@ auto HinaPE::PhysicsSystem::_pause_() -> void
 
 auto HinaPE::PhysicsSystem::_tick_(float dt) -> void
 {
+    HINAPE_PROFILE_ZONE("physics.tick");
+    DeterministicScope scope(deterministic);
+    recategorize();
+    collision.mark_stale();
     std::visit([&](auto &k)
                {
                    k.simulate(dt);
                }, kernel);
+    rigid.simulate(dt);
+}
+
+auto HinaPE::PhysicsSystem::_frame_(float dt) -> void
+{
+    HINAPE_PROFILE_ZONE("physics.frame");
+    DeterministicScope scope(deterministic);
+    int substeps = std::max(sub_step, 1);
+    if (step_opt.adaptive_substeps)
+    {
+        float h = std::visit([&](auto &k) { return k.stable_dt(step_opt.cfl); }, kernel);
+        if (h > 0 && dt > h * (float) substeps)
+            substeps = std::min((int) std::ceil(dt / h), std::max(step_opt.max_substeps, substeps));
+    }
+    substeps_taken = substeps;
+    for (int i = 0; i < substeps; ++i)
+        _tick_(dt / (float) substeps);
+    if (deterministic)
+        hashes.push_back(state_hash());
+    ++frame_count;
+    if (recording && frame_count % (unsigned long long) std::max(timeline_opt.interval, 1) == 0)
+        checkpoint();
+}
+
+auto HinaPE::PhysicsSystem::_advance_(float frame_dt) -> int
+{
+    const float fixed_dt = std::max(step_opt.fixed_dt, 1e-5f);
+    accumulator += std::max(frame_dt, 0.f);
+    int steps = 0;
+    while (accumulator >= fixed_dt && steps < step_opt.max_steps)
+    {
+        // the rigid poses are all the renderer interpolates, the deformables show their latest state
+        for_each_object([&](unsigned int id, PhysicsObject &o)
+                        {
+                            if (!o.is_rigidbody())
+                                return;
+                            auto &s = previous.objects[id];
+                            s.position = o.get_position();
+                            s.rotation = o.get_rotation();
+                        });
+        _frame_(fixed_dt);
+        accumulator -= fixed_dt;
+        ++steps;
+    }
+    if (accumulator >= fixed_dt)
+    {
+        dropped_frames += (unsigned long long) (accumulator / fixed_dt);
+        accumulator = std::fmod(accumulator, fixed_dt);
+    }
+    return steps;
+}
+
+auto HinaPE::PhysicsSystem::alpha() const -> float
+{
+    return accumulator / std::max(step_opt.fixed_dt, 1e-5f);
+}
+
+auto HinaPE::PhysicsSystem::_interpolate_(unsigned int ID, Vec3 &position, Vec3 &rotation) const -> void
+{
+    auto it = previous.objects.find(ID);
+    if (it == previous.objects.end())
+        return;
+    const float t = std::clamp(alpha(), 0.f, 1.f);
+    position = it->second.position + (position - it->second.position) * t;
+    for (int a = 0; a < 3; ++a)
+    {
+        // euler angles in degrees, blend along the shorter way around
+        float from = it->second.rotation[a];
+        float delta = std::remainder(rotation[a] - from, 360.f);
+        rotation[a] = from + delta * t;
+    }
+}
+
+auto HinaPE::PhysicsSystem::last_substeps() const -> int
+{
+    return substeps_taken;
+}
+
+auto HinaPE::PhysicsSystem::_set_deterministic_(bool on) -> void
+{
+    deterministic = on;
+    hashes.clear();
+}
+
+auto HinaPE::PhysicsSystem::is_deterministic() const -> bool
+{
+    return deterministic;
+}
+
+auto HinaPE::PhysicsSystem::state_hash() -> std::uint64_t
+{
+    HINAPE_PROFILE_ZONE("physics.state_hash");
+    // slot order depends on the history of erasures, the id order does not
+    std::vector<std::pair<unsigned int, PhysicsObject *>> alive;
+    for_each_object([&](unsigned int id, PhysicsObject &o) { alive.emplace_back(id, &o); });
+    std::sort(alive.begin(), alive.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    StateHasher hasher;
+    for (auto &[id, o]: alive)
+    {
+        hasher.add(static_cast<std::uint32_t>(id));
+        hasher.add(static_cast<std::uint32_t>(o->get_body_index()));
+        hasher.add(o->get_position());
+        hasher.add(o->get_rotation());
+        if (o->is<RigidBodyBase<DYNAMIC>>())
+        {
+            auto &body = o->get_object<RigidBodyBase<DYNAMIC>>();
+            hasher.add(body.get_linear_velocity());
+            hasher.add(body.get_angular_velocity());
+        } else if (o->is_deformable())
+            for (auto *s: {&o->get_vertices(), &o->get_velocities()})
+                for (int axis = 0; axis < 3; ++axis)
+                    hasher.add_stream(s->stream(axis));
+    }
+    if (auto *sph = std::get_if<SPHKernel>(&kernel))
+        for (auto *s: {&sph->particles.x, &sph->particles.y, &sph->particles.z, &sph->particles.vx, &sph->particles.vy, &sph->particles.vz})
+            hasher.add_stream(*s);
+    return hasher.h;
+}
+
+auto HinaPE::PhysicsSystem::frame_hashes() const -> const std::vector<std::uint64_t> &
+{
+    return hashes;
+}
+
+auto HinaPE::PhysicsSystem::first_divergence(const std::vector<std::uint64_t> &reference) const -> long
+{
+    auto [mine, theirs] = std::mismatch(hashes.begin(), hashes.end(), reference.begin(), reference.end());
+    if (mine == hashes.end() && theirs == reference.end())
+        return -1;
+    return static_cast<long>(mine - hashes.begin()); // a run that stops early diverges where it stops
+}
+
+auto HinaPE::PhysicsSystem::_save_(Snapshot &snapshot) -> void
+{
+    HINAPE_PROFILE_ZONE("physics.save");
+    snapshot.frame = frame_count;
+    SnapshotWriter out(snapshot.buffer);
+    out.value(static_cast<unsigned int>(kernel.index()));
+    out.value(frame_count);
+    out.value(accumulator);
+
+    // the object list first, so that a load can check it before touching anything
+    std::vector<std::array<unsigned int, 2>> objects; // id, body index
+    for_each_object([&](unsigned int id, PhysicsObject &o) { objects.push_back({id, static_cast<unsigned int>(o.get_body_index())}); });
+    out.array(objects);
+    std::apply([&](auto &...store) { ([&] { for (auto &e: store.values()) e.body->save(out); }(), ...); }, stores);
+
+    std::visit([&](auto &k) { k.save(out); }, kernel);
+    rigid.save(out);
+}
+
+auto HinaPE::PhysicsSystem::_load_(const Snapshot &snapshot) -> bool
+{
+    HINAPE_PROFILE_ZONE("physics.load");
+    SnapshotReader in(snapshot.buffer);
+    if (in.value<unsigned int>() != kernel.index())
+        return false;
+    auto frame = in.value<unsigned long long>();
+    auto acc = in.value<float>();
+    std::vector<std::array<unsigned int, 2>> saved, objects;
+    in.array(saved);
+    for_each_object([&](unsigned int id, PhysicsObject &o) { objects.push_back({id, static_cast<unsigned int>(o.get_body_index())}); });
+    if (saved != objects)
+        return false;
+
+    frame_count = frame;
+    accumulator = acc;
+    std::apply([&](auto &...store) { ([&] { for (auto &e: store.values()) e.body->load(in); }(), ...); }, stores);
+    std::visit([&](auto &k) { k.load(in); }, kernel);
+    rigid.load(in);
+    previous.objects.clear(); // do not blend across the jump
+    return true;
+}
+
+auto HinaPE::PhysicsSystem::_record_timeline_(bool on) -> void
+{
+    recording = on;
+    if (on)
+        checkpoint();
+}
+
+auto HinaPE::PhysicsSystem::_seek_(unsigned long long frame, float dt) -> bool
+{
+    HINAPE_PROFILE_ZONE("physics.seek");
+    auto it = std::upper_bound(timeline.begin(), timeline.end(), frame, [](unsigned long long f, const Snapshot &s) { return f < s.frame; });
+    if (it == timeline.begin())
+        return false;
+    if (!_load_(*std::prev(it)))
+        return false;
+    while (frame_count < frame)
+        _frame_(dt);
+    return true;
+}
+
+auto HinaPE::PhysicsSystem::_clear_timeline_() -> void
+{
+    for (auto &s: timeline)
+        spare_buffers.push_back(std::move(s.buffer));
+    timeline.clear();
+}
+
+auto HinaPE::PhysicsSystem::current_frame() const -> unsigned long long
+{
+    return frame_count;
+}
+
+auto HinaPE::PhysicsSystem::checkpoint() -> void
+{
+    // frames are usually recorded in order, a replay after a seek overwrites the snapshots it passes
+    auto it = std::lower_bound(timeline.begin(), timeline.end(), frame_count, [](const Snapshot &s, unsigned long long f) { return s.frame < f; });
+    if (it == timeline.end() || it->frame != frame_count)
+    {
+        if (timeline.size() >= std::max<size_t>(timeline_opt.capacity, 1))
+        {
+            if (it == timeline.begin())
+                return; // older than everything kept
+            spare_buffers.push_back(std::move(timeline.front().buffer));
+            timeline.pop_front();
+            it = std::lower_bound(timeline.begin(), timeline.end(), frame_count, [](const Snapshot &s, unsigned long long f) { return s.frame < f; });
+        }
+        Snapshot snapshot;
+        if (!spare_buffers.empty())
+        {
+            snapshot.buffer = std::move(spare_buffers.back());
+            spare_buffers.pop_back();
+        }
+        it = timeline.insert(it, std::move(snapshot));
+    }
+    _save_(*it);
+}
+
+auto HinaPE::PhysicsSystem::_step_(int n) -> void
+{
+    pending_steps += n;
+    control_cv.notify_one();
 }
 
 auto HinaPE::PhysicsSystem::instance() -> HinaPE::PhysicsSystem &
@@ -32,7 +315,278 @@ auto HinaPE::PhysicsSystem::destroy() -> void
     instance().~PhysicsSystem();
 }
 
+HinaPE::PhysicsSystem::PhysicsSystem() : collision(*this), rigid(*this), ccd(*this), kernel(FastMassSpringKernel(*this)) {}
+
+HinaPE::PhysicsSystem::~PhysicsSystem()
+{
+    _terminate_async_();
+}
+
 auto HinaPE::PhysicsSystem::_register_(unsigned int ID, std::shared_ptr<PhysicsObject> ptr) -> void // pass smart ptr by value
 {
-    physics_objects[ID] = std::move(ptr);
+    if (async)
+    {
+        // the worker owns the stores while it is alive, hand the object over on its next step
+        std::lock_guard<std::mutex> lock(register_mutex);
+        pending_commands.emplace_back([this, ID, ptr = std::move(ptr)]() mutable { insert(ID, std::move(ptr)); });
+        return;
+    }
+    insert(ID, std::move(ptr));
+}
+
+auto HinaPE::PhysicsSystem::_erase_(unsigned int ID) -> void
+{
+    auto erase = [this, ID]()
+    {
+        auto it = handles.find(ID);
+        if (it != handles.end())
+            visit_store(it->second.body_index, [&](auto &store) { store.retire(it->second.slot); });
+        previous.objects.erase(ID); // a restored object starts from its current pose
+    };
+    ccd.remove_collider(ID); // right away, like set_collider: a deferred removal would drop the shape set again by a restore
+    if (async)
+    {
+        std::lock_guard<std::mutex> lock(register_mutex);
+        pending_commands.emplace_back(erase);
+        return;
+    }
+    erase();
+}
+
+auto HinaPE::PhysicsSystem::_restore_(unsigned int ID) -> void
+{
+    auto restore = [this, ID]()
+    {
+        auto it = handles.find(ID);
+        if (it != handles.end())
+            visit_store(it->second.body_index, [&](auto &store) { store.revive(it->second.slot); });
+    };
+    if (async)
+    {
+        std::lock_guard<std::mutex> lock(register_mutex);
+        pending_commands.emplace_back(restore);
+        return;
+    }
+    restore();
+}
+
+auto HinaPE::PhysicsSystem::_switch_rigidbody_type_(unsigned int ID, RigidBodyType to) -> void
+{
+    auto switch_type = [this, ID, to]()
+    {
+        auto it = handles.find(ID);
+        if (it == handles.end())
+            return;
+        std::shared_ptr<PhysicsObject> owner;
+        visit_store(it->second.body_index, [&](auto &store)
+        {
+            if (auto *e = store.get(it->second.slot))
+                owner = e->owner;
+        });
+        if (!owner || !owner->is_rigidbody() || owner->get_rigid_body_type() == to)
+            return;
+        const bool alive = contains(ID);
+        owner->switch_rigidbody_type(to);
+        insert(ID, std::move(owner)); // the stored body pointer refers to the replaced body, move the entry now
+        if (!alive)
+            visit_store(handles[ID].body_index, [&](auto &store) { store.retire(handles[ID].slot); });
+    };
+    if (async)
+    {
+        std::lock_guard<std::mutex> lock(register_mutex);
+        pending_commands.emplace_back(switch_type);
+        return;
+    }
+    switch_type();
+}
+
+auto HinaPE::PhysicsSystem::_clear_() -> void
+{
+    auto clear = [this]()
+    {
+        std::apply([](auto &...store) { (store.clear(), ...); }, stores);
+        handles.clear();
+        previous.objects.clear();
+        frame_count = 0;
+        _clear_timeline_();
+    };
+    ccd.clear_colliders();
+    if (async)
+    {
+        std::lock_guard<std::mutex> lock(register_mutex);
+        pending_commands.emplace_back(clear);
+        return;
+    }
+    clear();
+}
+
+auto HinaPE::PhysicsSystem::contains(unsigned int ID) const -> bool
+{
+    auto it = handles.find(ID);
+    if (it == handles.end())
+        return false;
+    bool alive = false;
+    int body_index = 0;
+    std::apply([&](const auto &...store) { ((alive |= body_index++ == it->second.body_index && store.is_alive(it->second.slot)), ...); }, stores);
+    return alive;
+}
+
+auto HinaPE::PhysicsSystem::insert(unsigned int ID, std::shared_ptr<PhysicsObject> ptr) -> void
+{
+    remove(ID); // re-registering an id replaces the previous object
+    if (!ptr)
+        return;
+    int body_index = ptr->get_body_index();
+    visit_store(body_index, [&](auto &store)
+    {
+        using Entry = typename std::remove_reference_t<decltype(store.values())>::value_type;
+        using Body = std::remove_pointer_t<decltype(Entry::body)>;
+        auto *body = &ptr->get_object<Body>();
+        handles[ID] = {body_index, store.insert(Entry{ID, body, std::move(ptr)})};
+    });
+}
+
+auto HinaPE::PhysicsSystem::remove(unsigned int ID) -> void
+{
+    auto it = handles.find(ID);
+    if (it == handles.end())
+        return;
+    visit_store(it->second.body_index, [&](auto &store) { store.erase(it->second.slot); });
+    handles.erase(it);
+}
+
+auto HinaPE::PhysicsSystem::recategorize() -> void
+{
+    std::vector<std::pair<unsigned int, std::shared_ptr<PhysicsObject>>> moved;
+    std::apply([&](auto &...store)
+               {
+                   int body_index = 0;
+                   ([&]
+                   {
+                       for (auto &e: store.values())
+                           if (e.owner->get_body_index() != body_index)
+                               moved.emplace_back(e.id, e.owner);
+                       ++body_index;
+                   }(), ...);
+               }, stores);
+    for (auto &m: moved)
+        insert(m.first, std::move(m.second));
+}
+
+auto HinaPE::PhysicsSystem::_launch_async_(const AsyncOpt &opt) -> void
+{
+    if (async)
+        return;
+    async_opt = opt;
+    quit = false;
+    async = true;
+    publish(0.0); // make the current state visible before the first step
+    worker = std::thread(&PhysicsSystem::simulation_loop, this);
+}
+
+auto HinaPE::PhysicsSystem::_terminate_async_() -> void
+{
+    if (!async)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        quit = true;
+    }
+    control_cv.notify_one();
+    if (worker.joinable())
+        worker.join();
+    async = false;
+    flush_registered();
+}
+
+auto HinaPE::PhysicsSystem::is_async() const -> bool
+{
+    return async;
+}
+
+auto HinaPE::PhysicsSystem::_fetch_() -> bool
+{
+    return states.fetch();
+}
+
+auto HinaPE::PhysicsSystem::_state_() const -> const PhysicsState &
+{
+    return states.read_buffer();
+}
+
+auto HinaPE::PhysicsSystem::simulation_loop() -> void
+{
+    using clock = std::chrono::steady_clock;
+    const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(async_opt.fixed_dt));
+    auto deadline = clock::now();
+    double time = 0.0;
+
+    while (!quit)
+    {
+        {
+            // sleep while paused and no single steps are requested
+            std::unique_lock<std::mutex> lock(control_mutex);
+            if (!control_cv.wait_for(lock, std::chrono::milliseconds(10), [&] { return quit || running || pending_steps > 0; }))
+                continue; // `running` may be flipped without notification, poll it
+        }
+        if (quit)
+            break;
+
+        bool single_step = !running && pending_steps > 0;
+        if (single_step)
+            --pending_steps;
+
+        flush_registered();
+        _frame_(async_opt.fixed_dt);
+        time += async_opt.fixed_dt;
+
+        if (async_opt.back_pressure == BackPressure::Block)
+            while (states.has_unread() && !quit)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+        publish(time);
+
+        if (single_step)
+        {
+            deadline = clock::now();
+            continue;
+        }
+
+        // keep a fixed stepping rate
+        deadline += period;
+        auto now = clock::now();
+        if (now > deadline)
+        {
+            // never replay missed ticks: in block mode the renderer paces us anyway
+            if (async_opt.back_pressure == BackPressure::DropFrames)
+                dropped_frames += (now - deadline) / period;
+            deadline = now;
+        } else
+            std::this_thread::sleep_until(deadline);
+    }
+}
+
+auto HinaPE::PhysicsSystem::flush_registered() -> void
+{
+    std::lock_guard<std::mutex> lock(register_mutex);
+    for (auto &command: pending_commands)
+        command();
+    pending_commands.clear();
+}
+
+auto HinaPE::PhysicsSystem::publish(double time) -> void
+{
+    HINAPE_PROFILE_ZONE("physics.publish");
+    auto &state = states.write_buffer();
+    state.frame = ++published_frames;
+    state.time = time;
+    std::erase_if(state.objects, [&](const auto &pair) { return !contains(pair.first); }); // the buffer still holds the objects of an older frame
+    for_each_object([&](unsigned int id, PhysicsObject &o)
+                    {
+                        auto &s = state.objects[id];
+                        s.position = o.get_position();
+                        s.rotation = o.get_rotation();
+                        if (o.is_deformable())
+                            o.get_vertices().gather(s.vertices); // reuses the capacity of the slot
+                    });
+    states.publish();
 }
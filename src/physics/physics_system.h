@@ -5,49 +5,267 @@
 #include "kernels/xpbd/xpbd_kernel.h"
 #include "kernels/fast-mass-spring/fms_kernel.h"
 #include "kernels/sph/sph_kernel.h"
+#include "kernels/collision/simple_collision.h"
+#include "kernels/collision/continuous_collision.h"
+#include "kernels/rigid/rigid_solver.h"
 #include "physics_object.h"
+#include "physics_state.h"
+#include "util/triple_buffer.h"
+#include "util/slot_map.h"
+#include "util/snapshot.h"
 
 #include <vector>
+#include <deque>
 #include <variant>
 #include <map>
+#include <unordered_map>
+#include <tuple>
+#include <type_traits>
+#include <span>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
 
 namespace HinaPE
 {
+// one registered object, stored densely per body type
+template<typename T>
+struct PhysicsEntry
+{
+    unsigned int id; // scene id
+    T *body; // the body held by owner, no variant dispatch needed
+    std::shared_ptr<PhysicsObject> owner;
+};
+
+// One simulation context. The app drives the shared instance(), more contexts may live side by side (see Ensemble):
+// they share nothing but the thread pool.
 class PhysicsSystem
 {
-public: // Singleton Pattern
-    static auto instance() -> PhysicsSystem &;
+public:
+    static auto instance() -> PhysicsSystem &; // the context of the app
     static auto destroy() -> void;
+    PhysicsSystem();
+    ~PhysicsSystem();
 
 public:
     auto _start_() -> void;
     auto _pause_() -> void;
     auto _tick_(float dt) -> void;
+    auto _frame_(float dt) -> void; // one step of dt, split into sub_step (or more, with adaptive substeps) ticks
+    auto _step_(int n) -> void; // advance n steps on the simulation thread, even when paused
     auto _register_(unsigned int ID, std::shared_ptr<PhysicsObject> ptr) -> void;
+    auto _erase_(unsigned int ID) -> void; // keep the object as a tombstone, in case of UNDO, its ccd collider is dropped
+    auto _restore_(unsigned int ID) -> void; // the ccd collider is not restored, set it again
+    auto _switch_rigidbody_type_(unsigned int ID, RigidBodyType to) -> void; // replaces the body in place, so it runs on the simulation thread when async
+    auto _clear_() -> void;
+    template<typename Kernel>
+    auto _use_kernel_() -> Kernel &; // switch the deformable solver (its caches start over), return it to set its options
+    template<typename Kernel>
+    auto current_kernel() -> Kernel *; // the deformable solver if it is a Kernel, nullptr otherwise
+
+public: // dense iteration for kernels
+    template<typename T>
+    auto objects() -> std::span<PhysicsEntry<T>>; // alive objects of one body type
+    template<typename Func>
+    auto for_each_object(Func &&func) -> void; // func(id, PhysicsObject &) for every alive object
+    auto contains(unsigned int ID) const -> bool; // registered and not erased
+
+public: // fixed timestep stepping of the render loop
+    struct StepOpt
+    {
+        float fixed_dt = 1 / 60.f;
+        int max_steps = 4; // per _advance_, the time left beyond is dropped so that slow steps cannot pile up (spiral of death)
+        bool adaptive_substeps = false; // raise the substep count when the kernel's CFL bound asks for it
+        float cfl = 0.5f;
+        int max_substeps = 64;
+    };
+    StepOpt step_opt;
+    auto _advance_(float frame_dt) -> int; // accumulate the frame time and run the fixed steps it covers, return their count
+    auto alpha() const -> float; // time left in the accumulator in fixed steps, in [0, 1)
+    auto _interpolate_(unsigned int ID, Vec3 &position, Vec3 &rotation) const -> void; // blend the current pose with the one before the last step by alpha()
+    auto last_substeps() const -> int;
+
+public: // bitwise reproducible runs, e.g. to replay a bug or to check a parallel change against the serial build
+    auto _set_deterministic_(bool on) -> void; // fixed chunking in the parallel reductions of this context's steps (a DeterministicScope, other contexts keep their mode), a state hash is recorded after each _frame_
+    auto is_deterministic() const -> bool;
+    auto state_hash() -> std::uint64_t; // FNV-1a over the bits of every alive object's state (by id) and of the SPH particles
+    auto frame_hashes() const -> const std::vector<std::uint64_t> &; // one per _frame_ since the deterministic mode was turned on
+    auto first_divergence(const std::vector<std::uint64_t> &reference) const -> long; // first frame whose hash differs from a recorded run, -1 if none
+
+public: // checkpoints of the object and solver state, and a timeline of them to scrub back and forth
+    struct Snapshot
+    {
+        unsigned long long frame = 0;
+        SnapshotBuffer buffer;
+    };
+    auto _save_(Snapshot &snapshot) -> void; // reuses the buffer of snapshot
+    auto _load_(const Snapshot &snapshot) -> bool; // false (nothing restored) if the objects or the kernel changed since the save
+    struct TimelineOpt
+    {
+        int interval = 30; // frames between two snapshots, a seek simulates at most interval - 1 frames
+        size_t capacity = 128; // snapshots kept, the oldest are dropped first
+    };
+    TimelineOpt timeline_opt;
+    auto _record_timeline_(bool on) -> void; // snapshot the current frame, then every interval frames
+    auto _seek_(unsigned long long frame, float dt) -> bool; // load the last snapshot at or before frame, then step up to frame with steps of dt
+    auto _clear_timeline_() -> void; // after editing the scene, the recorded future would replay the old one
+    auto current_frame() const -> unsigned long long; // _frame_ calls since _clear_, rewound by _load_
+
+public: // asynchronous stepping on a dedicated simulation thread
+    enum class BackPressure
+    {
+        DropFrames, // never wait for the renderer; skip missed ticks when the solver falls behind
+        Block // publish a new state only after the renderer consumed the previous one
+    };
+    struct AsyncOpt
+    {
+        float fixed_dt = 1 / 60.f;
+        BackPressure back_pressure = BackPressure::DropFrames;
+    };
+    auto _launch_async_(const AsyncOpt &opt) -> void;
+    auto _terminate_async_() -> void;
+    auto is_async() const -> bool;
+    auto _fetch_() -> bool; // acquire the latest completed state (render thread only), return true if it is new
+    auto _state_() const -> const PhysicsState &; // last acquired state (render thread only)
 
 public:
-    bool running = true;
+    std::atomic<bool> running = true;
     int sub_step = 5;
+    std::atomic<unsigned long long> dropped_frames = 0; // steps skipped by the async loop or by the max_steps clamp
+    SimpleCollision collision; // broadphase, updated by the kernels' collision stage
+    RigidBodySolver rigid; // dynamic rigid bodies, stepped after the deformable kernel
+    ContinuousCollision ccd; // swept cloths against static colliders, set_collider may be called from any thread
 
-public:
+public: // the kernels keep a reference to their system
     PhysicsSystem(const PhysicsSystem &) = delete;
     PhysicsSystem(PhysicsSystem &&) = delete;
     auto operator=(const PhysicsSystem &) -> PhysicsSystem & = delete;
     auto operator=(PhysicsSystem &&) -> PhysicsSystem & = delete;
-private: // disable any instantiation outside
-    PhysicsSystem() : kernel(FastMassSpringKernel(*this)) {}
-    ~PhysicsSystem() = default;
+
+private:
+    auto simulation_loop() -> void;
+    auto flush_registered() -> void;
+    auto publish(double time) -> void;
 
 private:
     friend PBDKernel;
     friend XPBDKernel;
     friend FastMassSpringKernel;
     friend SPHKernel;
+    friend SimpleCollision;
     std::variant<PBDKernel, XPBDKernel, FastMassSpringKernel, SPHKernel> kernel;
-    std::map<const unsigned int, std::shared_ptr<PhysicsObject>> physics_objects;
-    std::map<const unsigned int, std::shared_ptr<PhysicsObject>> erased_physics_objects; // don't delete object instantly, in case UNDO operation.
     std::vector<Constraint> constraints;
+
+private: // object storage, one slot map per body type (in PhysicsObject's variant order)
+    template<typename T>
+    using Store = SlotMap<PhysicsEntry<T>>;
+    std::tuple<Store<RigidBodyBase<DYNAMIC>>, Store<RigidBodyBase<STATIC>>, Store<RigidBodyBase<KINEMATIC>>, Store<DeformableBase<CLOTH>>, Store<DeformableBase<MESH>>> stores;
+    struct Handle
+    {
+        int body_index = -1;
+        SlotHandle slot;
+    };
+    std::unordered_map<unsigned int, Handle> handles; // scene id -> slot
+
+    auto insert(unsigned int ID, std::shared_ptr<PhysicsObject> ptr) -> void;
+    auto remove(unsigned int ID) -> void;
+    auto recategorize() -> void; // move objects whose body type was switched to their new store
+    template<typename Func>
+    auto visit_store(int body_index, Func &&func) -> void;
+
+private: // fixed timestep
+    float accumulator = 0;
+    int substeps_taken = 0;
+    PhysicsState previous; // poses before the last fixed step
+
+private: // timeline
+    auto checkpoint() -> void;
+    unsigned long long frame_count = 0;
+    bool recording = false;
+    std::deque<Snapshot> timeline; // by frame
+    std::vector<SnapshotBuffer> spare_buffers; // of dropped snapshots, the next ones are taken into them
+
+private: // determinism
+    bool deterministic = false;
+    std::vector<std::uint64_t> hashes;
+
+private: // simulation thread
+    AsyncOpt async_opt;
+    std::thread worker;
+    std::atomic<bool> async = false;
+    std::atomic<bool> quit = false;
+    std::atomic<int> pending_steps = 0;
+    std::mutex control_mutex;
+    std::condition_variable control_cv;
+    std::mutex register_mutex;
+    std::vector<std::function<void()>> pending_commands; // register/erase/restore, handed over to the worker on its next step
+    TripleBuffer<PhysicsState> states;
+    unsigned long long published_frames = 0;
 };
+
+template<typename Kernel>
+auto PhysicsSystem::_use_kernel_() -> Kernel &
+{
+    if (auto *k = std::get_if<Kernel>(&kernel))
+        return *k;
+    if constexpr (std::is_constructible_v<Kernel, PhysicsSystem &>)
+        return kernel.template emplace<Kernel>(*this);
+    else
+        return kernel.template emplace<Kernel>();
+}
+
+template<typename Kernel>
+auto PhysicsSystem::current_kernel() -> Kernel *
+{
+    return std::get_if<Kernel>(&kernel);
+}
+
+template<typename T>
+auto PhysicsSystem::objects() -> std::span<PhysicsEntry<T>>
+{
+    return std::get<Store<T>>(stores).values();
+}
+
+template<typename Func>
+auto PhysicsSystem::for_each_object(Func &&func) -> void
+{
+    std::apply([&](auto &...store)
+               {
+                   ([&]
+                   {
+                       for (auto &e: store.values())
+                           func(e.id, *e.owner);
+                   }(), ...);
+               }, stores);
+}
+
+template<typename Func>
+auto PhysicsSystem::visit_store(int body_index, Func &&func) -> void
+{
+    switch (body_index)
+    {
+        case 0:
+            func(std::get<0>(stores));
+            break;
+        case 1:
+            func(std::get<1>(stores));
+            break;
+        case 2:
+            func(std::get<2>(stores));
+            break;
+        case 3:
+            func(std::get<3>(stores));
+            break;
+        case 4:
+            func(std::get<4>(stores));
+            break;
+        default:
+            break;
+    }
+}
 }
 
 #endif //HINAPE_PHYSICS_SYSTEM_H
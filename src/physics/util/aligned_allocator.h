@@ -0,0 +1,36 @@
+#ifndef HINAPE_ALIGNED_ALLOCATOR_H
+#define HINAPE_ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace HinaPE
+{
+// std::allocator replacement returning Alignment-aligned storage (cache line by default), for SIMD friendly streams
+template<typename T, std::size_t Alignment = 64>
+class AlignedAllocator
+{
+public:
+    using value_type = T;
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+    auto allocate(std::size_t n) -> T * { return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+    auto deallocate(T *p, std::size_t) noexcept -> void { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    template<typename U>
+    auto operator==(const AlignedAllocator<U, Alignment> &) const noexcept -> bool { return true; }
+    template<typename U>
+    auto operator!=(const AlignedAllocator<U, Alignment> &) const noexcept -> bool { return false; }
+};
+
+template<typename T, std::size_t Alignment = 64>
+using AlignedVector = std::vector<T, AlignedAllocator<T, Alignment>>;
+}
+
+#endif //HINAPE_ALIGNED_ALLOCATOR_H
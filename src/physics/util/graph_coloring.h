@@ -0,0 +1,49 @@
+#ifndef HINAPE_GRAPH_COLORING_H
+#define HINAPE_GRAPH_COLORING_H
+
+#include <cstdint>
+#include <vector>
+
+namespace HinaPE
+{
+// Partition constraints into batches whose constraints never share a particle (greedy graph coloring),
+// so that every batch can be projected in parallel without races.
+// particles_of(c, func) must call func(p) for every particle p touched by constraint c.
+// The result is deterministic: batches are filled in constraint order.
+struct ConstraintColoring
+{
+    std::vector<std::vector<unsigned int>> batches; // independent batches, safe to project in parallel
+    std::vector<unsigned int> conflicts; // constraints that did not fit in 64 colors, project them serially
+
+    template<typename ParticlesOf>
+    auto build(unsigned int constraints_num, unsigned int particles_num, const ParticlesOf &particles_of) -> void
+    {
+        batches.clear();
+        conflicts.clear();
+        used.assign(particles_num, 0);
+
+        for (unsigned int c = 0; c < constraints_num; ++c)
+        {
+            std::uint64_t forbidden = 0;
+            particles_of(c, [&](unsigned int p) { forbidden |= used[p]; });
+            if (~forbidden == 0)
+            {
+                conflicts.push_back(c);
+                continue;
+            }
+            unsigned int color = 0;
+            while (forbidden & (std::uint64_t(1) << color))
+                ++color;
+            particles_of(c, [&](unsigned int p) { used[p] |= std::uint64_t(1) << color; });
+            if (color >= batches.size())
+                batches.resize(color + 1);
+            batches[color].push_back(c);
+        }
+    }
+
+private:
+    std::vector<std::uint64_t> used; // colors already used around each particle
+};
+}
+
+#endif //HINAPE_GRAPH_COLORING_H
@@ -108,13 +108,13 @@ template<typename T>
 template<typename Callback>
 auto ArrayAccessor<T, 1>::parallelForEach(Callback func) -> void
 {
-    parallel_for(0, size(), [&](size_t i) { func(at(i)); });
+    parallel_for(static_cast<size_t>(0), size(), [&](size_t i) { func(at(i)); });
 }
 template<typename T>
 template<typename Callback>
 auto ArrayAccessor<T, 1>::parallelForEachIndex(Callback func) -> void
 {
-    parallel_for(0, size(), func);
+    parallel_for(static_cast<size_t>(0), size(), func);
 }
 template<typename T>
 auto ArrayAccessor<T, 1>::operator[](size_t i) -> T & { return _data[i]; }
@@ -209,13 +209,13 @@ template<typename T>
 template<typename Callback>
 void ConstArrayAccessor<T, 1>::parallelForEach(Callback func)
 {
-    // TODO: parallel for each
+    parallel_for(static_cast<size_t>(0), size(), [&](size_t i) { func(at(i)); });
 }
 template<typename T>
 template<typename Callback>
 void ConstArrayAccessor<T, 1>::parallelForEachIndex(Callback func)
 {
-    // TODO: parallel for each
+    parallel_for(static_cast<size_t>(0), size(), func);
 }
 template<typename T>
 auto ConstArrayAccessor<T, 1>::operator[](size_t i) const -> const T & { return _data[i]; }
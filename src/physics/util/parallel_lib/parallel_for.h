@@ -3,27 +3,274 @@
 
 #ifdef HINAPE_TBB_SUPPORT
 #include "tbb/parallel_for.h"
+#include "tbb/parallel_reduce.h"
+#include "tbb/global_control.h"
 #endif
-#include <thread>
+#include "task_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <vector>
 
 namespace HinaPE
 {
 enum class ExecutionPolicy { kSerial, kParallel };
 
+// grain: the smallest index range handed to one task, 0 lets the scheduler pick (about 8 tasks per thread)
+
 template<typename IndexType, typename Function>
-void parallel_for(IndexType start, IndexType end, const Function &func, ExecutionPolicy policy)
+void parallel_range_for(IndexType start, IndexType end, const Function &func, ExecutionPolicy policy = ExecutionPolicy::kParallel, IndexType grain = 0);
+
+template<typename IndexType, typename Function>
+void parallel_for(IndexType start, IndexType end, const Function &func, ExecutionPolicy policy = ExecutionPolicy::kParallel, IndexType grain = 0);
+
+// func(begin, end, init) -> Value reduces a sub-range, reduce(a, b) -> Value merges two partial results
+// partial results are merged in index order, so the result is reproducible for a fixed grain and thread count (for any
+// thread count and either policy in deterministic mode)
+template<typename IndexType, typename Value, typename Function, typename Reduce>
+auto parallel_reduce(IndexType start, IndexType end, const Value &identity, const Function &func, const Reduce &reduce, ExecutionPolicy policy = ExecutionPolicy::kParallel, IndexType grain = 0) -> Value;
+
+// out[i] = init + in[0] + ... + in[i - 1], returns the total (init + all inputs); in and out may alias
+template<typename InputIt, typename OutputIt, typename T, typename BinaryOp = std::plus<>>
+auto parallel_exclusive_scan(InputIt first, InputIt last, OutputIt out, T init, BinaryOp op = BinaryOp(), ExecutionPolicy policy = ExecutionPolicy::kParallel, size_t grain = 0) -> T;
+
+// pin the number of threads used by all parallel loops (the calling thread included)
+void set_max_number_of_threads(unsigned int number_of_threads);
+auto max_number_of_threads() -> unsigned int;
+
+// deterministic mode: reductions and scans split their range into chunks of a fixed size, whatever the thread count and
+// the policy, and merge the chunk results as a balanced tree in index order. Floating point results then match bitwise
+// between serial and parallel runs and across machines (same build), at the price of a coarser load balance.
+// It is on for the whole process after set_deterministic(true), or for the loops run under a DeterministicScope.
+void set_deterministic(bool on); // process-wide, every context and thread
+auto is_deterministic() -> bool; // process-wide mode or scope of the calling thread
+
+// sets the deterministic mode of the calling thread until destroyed, the tasks its parallel loops spawn inherit it:
+// a PhysicsSystem steps under its own mode without touching the other contexts
+class DeterministicScope
+{
+public:
+    explicit DeterministicScope(bool on);
+    ~DeterministicScope();
+    DeterministicScope(const DeterministicScope &) = delete;
+    auto operator=(const DeterministicScope &) -> DeterministicScope & = delete;
+
+private:
+    bool outer;
+};
+
+namespace internal
+{
+constexpr size_t kDeterministicGrain = 4096;
+
+inline auto deterministic_flag() -> std::atomic<bool> &
+{
+    static std::atomic<bool> flag = false;
+    return flag;
+}
+
+template<typename IndexType>
+auto auto_grain(IndexType n, IndexType grain) -> IndexType
+{
+    if (grain > 0)
+        return grain;
+    auto chunks = static_cast<IndexType>(8 * TaskScheduler::instance().size());
+    return std::max(static_cast<IndexType>(n / chunks), static_cast<IndexType>(1));
+}
+
+// the chunk size of reductions and scans, only the grain asked by the caller may be kept in deterministic mode
+template<typename IndexType>
+auto reduce_grain(IndexType n, IndexType grain) -> IndexType
 {
+    if (grain == 0 && is_deterministic())
+        return static_cast<IndexType>(kDeterministicGrain);
+    return auto_grain(n, grain);
+}
+
+// ((v0 v1) (v2 v3)) ((v4 v5) v6): the shape only depends on the number of values, values is consumed
+template<typename Value, typename Reduce>
+auto tree_reduce(std::vector<Value> &values, const Reduce &reduce) -> Value
+{
+    for (size_t width = 1; width < values.size(); width *= 2)
+        for (size_t i = 0; i + width < values.size(); i += 2 * width)
+            values[i] = reduce(values[i], values[i + width]);
+    return values.front();
+}
+}
+
+template<typename IndexType, typename Function>
+void parallel_range_for(IndexType start, IndexType end, const Function &func, ExecutionPolicy policy, IndexType grain)
+{
+    if (start >= end)
+        return;
+
+    IndexType n = end - start;
 #ifdef HINAPE_TBB_SUPPORT
-    tbb::parallel_for(start, end, func);
+    if (policy == ExecutionPolicy::kParallel)
+    {
+        const bool deterministic = internal::deterministic_scope(); // tbb tasks do not inherit it by themselves
+        tbb::parallel_for(tbb::blocked_range<IndexType>(start, end, internal::auto_grain(n, grain)), [&](const tbb::blocked_range<IndexType> &r)
+        {
+            DeterministicScope scope(deterministic);
+            func(r.begin(), r.end());
+        });
+        return;
+    }
+#endif
+    auto &scheduler = TaskScheduler::instance();
+    grain = internal::auto_grain(n, grain);
+    if (policy == ExecutionPolicy::kSerial || scheduler.size() == 1 || n <= grain)
+    {
+        func(start, end);
+        return;
+    }
 
-    tbb::parallel_for(tbb::blocked_range<IndexType>(start, end), [&](tbb::blocked_range<IndexType> r)
+    // split recursively, keep the left half and hand the right half out for stealing
+    std::atomic<size_t> pending = 0;
+    std::function<void(IndexType, IndexType)> split = [&](IndexType b, IndexType e)
     {
-        for (IndexType i = r.begin(); i != r.end(); ++i)
+        while (e - b > grain)
         {
+            IndexType mid = b + (e - b) / 2;
+            ++pending;
+            scheduler.spawn([&split, mid, e]() { split(mid, e); }, pending);
+            e = mid;
+        }
+        func(b, e);
+    };
+    split(start, end);
+    scheduler.wait(pending);
+}
+
+template<typename IndexType, typename Function>
+void parallel_for(IndexType start, IndexType end, const Function &func, ExecutionPolicy policy, IndexType grain)
+{
+    parallel_range_for(start, end, [&func](IndexType b, IndexType e)
+    {
+        for (IndexType i = b; i < e; ++i)
             func(i);
+    }, policy, grain);
+}
+
+template<typename IndexType, typename Value, typename Function, typename Reduce>
+auto parallel_reduce(IndexType start, IndexType end, const Value &identity, const Function &func, const Reduce &reduce, ExecutionPolicy policy, IndexType grain) -> Value
+{
+    if (start >= end)
+        return identity;
+    const bool deterministic = is_deterministic();
+    if (policy == ExecutionPolicy::kSerial && !deterministic)
+        return func(start, end, identity);
+
+    // fixed chunks, one partial result each
+    IndexType n = end - start;
+    grain = internal::reduce_grain(n, grain);
+    IndexType chunks = (n + grain - 1) / grain;
+    std::vector<Value> partial(static_cast<size_t>(chunks), identity);
+    parallel_for(static_cast<IndexType>(0), chunks, [&](IndexType c)
+    {
+        IndexType b = start + c * grain;
+        IndexType e = std::min(b + grain, end);
+        partial[static_cast<size_t>(c)] = func(b, e, identity);
+    }, policy, static_cast<IndexType>(1));
+
+    if (deterministic)
+        return reduce(identity, internal::tree_reduce(partial, reduce));
+    Value result = identity;
+    for (const auto &v: partial)
+        result = reduce(result, v);
+    return result;
+}
+
+template<typename InputIt, typename OutputIt, typename T, typename BinaryOp>
+auto parallel_exclusive_scan(InputIt first, InputIt last, OutputIt out, T init, BinaryOp op, ExecutionPolicy policy, size_t grain) -> T
+{
+    auto n = static_cast<size_t>(std::distance(first, last));
+    if (n == 0)
+        return init;
+
+    const bool deterministic = is_deterministic();
+    grain = std::max(internal::reduce_grain(n, grain), static_cast<size_t>(1024));
+    if ((policy == ExecutionPolicy::kSerial && !deterministic) || n <= grain)
+    {
+        T sum = init;
+        for (size_t i = 0; i < n; ++i)
+        {
+            T v = first[i];
+            out[i] = sum;
+            sum = op(sum, v);
+        }
+        return sum;
+    }
+
+    // 1. sum every chunk, 2. scan the chunk sums, 3. scan every chunk from its offset
+    size_t chunks = (n + grain - 1) / grain;
+    std::vector<T> offsets(chunks);
+    parallel_for(static_cast<size_t>(0), chunks, [&](size_t c)
+    {
+        size_t b = c * grain, e = std::min(b + grain, n);
+        T sum = first[b];
+        for (size_t i = b + 1; i < e; ++i)
+            sum = op(sum, first[i]);
+        offsets[c] = sum;
+    }, policy, static_cast<size_t>(1));
+
+    T total = init;
+    for (size_t c = 0; c < chunks; ++c)
+    {
+        T sum = offsets[c];
+        offsets[c] = total;
+        total = op(total, sum);
+    }
+
+    parallel_for(static_cast<size_t>(0), chunks, [&](size_t c)
+    {
+        size_t b = c * grain, e = std::min(b + grain, n);
+        T sum = offsets[c];
+        for (size_t i = b; i < e; ++i)
+        {
+            T v = first[i];
+            out[i] = sum;
+            sum = op(sum, v);
         }
-    });
+    }, policy, static_cast<size_t>(1));
+    return total;
+}
+
+inline void set_max_number_of_threads(unsigned int number_of_threads)
+{
+#ifdef HINAPE_TBB_SUPPORT
+    static std::unique_ptr<tbb::global_control> control;
+    control = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, std::max(number_of_threads, 1u));
 #endif
+    TaskScheduler::instance().resize(number_of_threads);
+}
+
+inline auto max_number_of_threads() -> unsigned int
+{
+    return TaskScheduler::instance().size();
+}
+
+inline void set_deterministic(bool on)
+{
+    internal::deterministic_flag().store(on, std::memory_order_relaxed);
+}
+
+inline auto is_deterministic() -> bool
+{
+    return internal::deterministic_flag().load(std::memory_order_relaxed) || internal::deterministic_scope();
+}
+
+inline DeterministicScope::DeterministicScope(bool on) : outer(internal::deterministic_scope())
+{
+    internal::deterministic_scope() = on;
+}
+
+inline DeterministicScope::~DeterministicScope()
+{
+    internal::deterministic_scope() = outer;
 }
 }
 
@@ -0,0 +1,149 @@
+#include "task_scheduler.h"
+
+#include <algorithm>
+
+namespace
+{
+thread_local int worker_index = -1; // -1 for threads not owned by the scheduler
+thread_local bool deterministic = false;
+}
+
+auto HinaPE::internal::deterministic_scope() -> bool &
+{
+    return deterministic;
+}
+
+auto HinaPE::TaskScheduler::instance() -> HinaPE::TaskScheduler &
+{
+    static TaskScheduler instance;
+    return instance;
+}
+
+HinaPE::TaskScheduler::TaskScheduler()
+{
+    start(std::max(std::thread::hardware_concurrency(), 1u));
+}
+
+HinaPE::TaskScheduler::~TaskScheduler()
+{
+    stop();
+}
+
+auto HinaPE::TaskScheduler::spawn(std::function<void()> task, std::atomic<size_t> &pending) -> void
+{
+    auto &q = *queues[home_queue()];
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        ++queued; // before the task is visible, a thief's --queued must never run first and wrap the counter
+        q.tasks.push_back({std::move(task), &pending, deterministic});
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex); // pairs with the predicate check in worker_loop, avoid lost wakeups
+    }
+    wake.notify_one();
+}
+
+auto HinaPE::TaskScheduler::wait(std::atomic<size_t> &pending) -> void
+{
+    auto home = home_queue();
+    while (pending.load(std::memory_order_acquire) > 0)
+        if (!try_execute_one(home))
+            std::this_thread::yield();
+}
+
+auto HinaPE::TaskScheduler::resize(unsigned int number_of_threads) -> void
+{
+    number_of_threads = std::max(number_of_threads, 1u);
+    if (number_of_threads == size())
+        return;
+    stop();
+    start(number_of_threads);
+}
+
+auto HinaPE::TaskScheduler::size() const -> unsigned int
+{
+    return static_cast<unsigned int>(workers.size()) + 1;
+}
+
+auto HinaPE::TaskScheduler::start(unsigned int number_of_threads) -> void
+{
+    stopping = false;
+    queues.clear();
+    for (unsigned int i = 0; i < number_of_threads; ++i)
+        queues.emplace_back(std::make_unique<Queue>());
+    for (unsigned int i = 0; i + 1 < number_of_threads; ++i)
+        workers.emplace_back(&TaskScheduler::worker_loop, this, i);
+}
+
+auto HinaPE::TaskScheduler::stop() -> void
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &w: workers)
+        if (w.joinable())
+            w.join();
+    workers.clear();
+}
+
+auto HinaPE::TaskScheduler::worker_loop(unsigned int index) -> void
+{
+    worker_index = static_cast<int>(index);
+    while (!stopping)
+    {
+        if (try_execute_one(index))
+            continue;
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait(lock, [&] { return stopping || queued > 0; });
+    }
+}
+
+auto HinaPE::TaskScheduler::try_execute_one(unsigned int home) -> bool
+{
+    Task task{};
+    bool found = false;
+
+    // own queue first, newest task (LIFO keeps the working set hot)
+    {
+        auto &q = *queues[home];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty())
+        {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    // then steal the oldest (largest) task from a victim
+    for (size_t k = 1; !found && k < queues.size(); ++k)
+    {
+        auto &q = *queues[(home + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty())
+        {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if (!found)
+        return false;
+
+    --queued;
+    const bool outer = deterministic; // a waiting thread runs other tasks between its own
+    deterministic = task.deterministic;
+    task.func();
+    deterministic = outer;
+    task.pending->fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+}
+
+auto HinaPE::TaskScheduler::home_queue() const -> unsigned int
+{
+    // external threads (ui, simulation thread) all share the last queue
+    return worker_index >= 0 ? static_cast<unsigned int>(worker_index) : static_cast<unsigned int>(queues.size() - 1);
+}
@@ -0,0 +1,70 @@
+#ifndef HINAPE_TASK_SCHEDULER_H
+#define HINAPE_TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace HinaPE
+{
+// Persistent work-stealing thread pool behind parallel_for & co.
+// Every worker owns a deque: it pushes/pops its own tasks at the back and steals from the front of the others.
+// A thread waiting on a task group keeps executing queued tasks, so nested parallel loops never deadlock.
+class TaskScheduler
+{
+public:
+    static auto instance() -> TaskScheduler &;
+
+    auto spawn(std::function<void()> task, std::atomic<size_t> &pending) -> void; // pending is decreased once task finished
+    auto wait(std::atomic<size_t> &pending) -> void; // help executing tasks until pending reaches zero
+    auto resize(unsigned int number_of_threads) -> void; // must not be called while parallel work is in flight
+    auto size() const -> unsigned int; // number of threads taking part in a parallel loop, the caller included
+
+public:
+    TaskScheduler(const TaskScheduler &) = delete;
+    TaskScheduler(TaskScheduler &&) = delete;
+    auto operator=(const TaskScheduler &) -> TaskScheduler & = delete;
+    auto operator=(TaskScheduler &&) -> TaskScheduler & = delete;
+private:
+    TaskScheduler();
+    ~TaskScheduler();
+
+private:
+    struct Task
+    {
+        std::function<void()> func;
+        std::atomic<size_t> *pending;
+        bool deterministic; // deterministic scope of the spawning thread, the task runs under it
+    };
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    auto start(unsigned int number_of_threads) -> void;
+    auto stop() -> void;
+    auto worker_loop(unsigned int index) -> void;
+    auto try_execute_one(unsigned int home) -> bool;
+    auto home_queue() const -> unsigned int;
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker, plus one shared by external threads
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued = 0;
+    std::atomic<bool> stopping = false;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+};
+
+namespace internal
+{
+auto deterministic_scope() -> bool &; // of the calling thread, see DeterministicScope
+}
+}
+
+#endif //HINAPE_TASK_SCHEDULER_H
@@ -0,0 +1,230 @@
+#ifndef HINAPE_PROFILER_H
+#define HINAPE_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace HinaPE
+{
+// Scoped timing zones for finding where a tick goes.
+// Every thread records into its own ring buffer (no lock, no allocation once the ring exists), the rings outlive their
+// threads and are gathered by collect(). Zones are compiled in with HINAPE_PROFILE and cost a relaxed load while the
+// profiler is disabled. Gather and export while no zone is running, e.g. between two steps: a ring that wraps during
+// collect() may hand out a torn event.
+//
+//      HINAPE_PROFILE_ZONE("xpbd.substep"); // times the enclosing scope, the name must outlive the profiler
+//
+// The trace opens in chrome://tracing or https://ui.perfetto.dev.
+class Profiler
+{
+public:
+    struct Event
+    {
+        const char *name;
+        std::int64_t begin, end; // ns since the profiler was created
+        std::uint32_t thread;
+    };
+    struct Stats
+    {
+        std::string name;
+        std::size_t count = 0;
+        double total_ms = 0, min_ms = 0, max_ms = 0, mean_ms = 0;
+    };
+    struct Opt
+    {
+        std::size_t ring_size = 1 << 16; // events kept per thread, older ones are overwritten
+    };
+
+    static auto instance() -> Profiler &
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    auto enable(bool on) -> void { enabled_flag.store(on, std::memory_order_relaxed); }
+    auto enabled() const -> bool { return enabled_flag.load(std::memory_order_relaxed); }
+    auto set_opt(const Opt &o) -> void; // only affects rings created afterwards
+    auto now() const -> std::int64_t { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count(); }
+    auto record(const char *name, std::int64_t begin, std::int64_t end) -> void;
+
+    auto clear() -> void;
+    auto collect() const -> std::vector<Event>; // events of all threads, by begin time
+    auto stats() const -> std::vector<Stats>; // per zone name, by total time
+    auto write_chrome_trace(std::ostream &out) const -> void;
+    auto write_chrome_trace(const std::string &path) const -> bool;
+    auto report(std::ostream &out) const -> void; // stats as a text table
+
+private:
+    struct Ring
+    {
+        std::vector<Event> events;
+        std::atomic<std::uint64_t> head{0}; // events ever written
+        std::uint32_t thread = 0;
+    };
+
+    Profiler() : epoch(std::chrono::steady_clock::now()) {}
+    auto local_ring() -> Ring &;
+
+    std::chrono::steady_clock::time_point epoch;
+    std::atomic<bool> enabled_flag{false};
+    mutable std::mutex rings_mutex;
+    std::vector<std::shared_ptr<Ring>> rings; // one per thread that ever recorded
+    Opt opt;
+};
+
+// times its scope into the calling thread's ring
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char *name) : name(name), begin(Profiler::instance().enabled() ? Profiler::instance().now() : -1) {}
+    ~ProfileZone()
+    {
+        if (begin >= 0)
+            Profiler::instance().record(name, begin, Profiler::instance().now());
+    }
+    ProfileZone(const ProfileZone &) = delete;
+    auto operator=(const ProfileZone &) -> ProfileZone & = delete;
+
+private:
+    const char *name;
+    std::int64_t begin;
+};
+
+inline auto Profiler::set_opt(const Opt &o) -> void
+{
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    opt = o;
+    opt.ring_size = std::max<std::size_t>(opt.ring_size, 1);
+}
+
+inline auto Profiler::local_ring() -> Ring &
+{
+    thread_local std::shared_ptr<Ring> ring;
+    if (!ring)
+    {
+        ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        ring->events.resize(opt.ring_size);
+        ring->thread = static_cast<std::uint32_t>(rings.size());
+        rings.push_back(ring);
+    }
+    return *ring;
+}
+
+inline auto Profiler::record(const char *name, std::int64_t begin, std::int64_t end) -> void
+{
+    auto &ring = local_ring();
+    auto head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head % ring.events.size()] = {name, begin, end, ring.thread};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+inline auto Profiler::clear() -> void
+{
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (auto &ring: rings)
+        ring->head.store(0, std::memory_order_release);
+}
+
+inline auto Profiler::collect() const -> std::vector<Event>
+{
+    std::vector<Event> out;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        for (auto &ring: rings)
+        {
+            auto head = ring->head.load(std::memory_order_acquire);
+            auto size = static_cast<std::uint64_t>(ring->events.size());
+            for (auto i = head > size ? head - size : 0; i < head; ++i)
+                out.push_back(ring->events[i % size]);
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const Event &a, const Event &b) { return a.begin < b.begin; });
+    return out;
+}
+
+inline auto Profiler::stats() const -> std::vector<Stats>
+{
+    std::map<std::string_view, Stats> by_name;
+    for (auto &e: collect())
+    {
+        auto &s = by_name[e.name];
+        double ms = static_cast<double>(e.end - e.begin) * 1e-6;
+        s.min_ms = s.count ? std::min(s.min_ms, ms) : ms;
+        s.max_ms = s.count ? std::max(s.max_ms, ms) : ms;
+        s.total_ms += ms;
+        ++s.count;
+    }
+    std::vector<Stats> out;
+    for (auto &[name, s]: by_name)
+    {
+        s.name = name;
+        s.mean_ms = s.total_ms / static_cast<double>(s.count);
+        out.push_back(s);
+    }
+    std::sort(out.begin(), out.end(), [](const Stats &a, const Stats &b) { return a.total_ms > b.total_ms; });
+    return out;
+}
+
+inline auto Profiler::write_chrome_trace(std::ostream &out) const -> void
+{
+    // complete events ("ph": "X"), timestamps and durations in microseconds
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (auto &e: collect())
+    {
+        out << (first ? "\n" : ",\n") << "{\"name\":\"";
+        for (const char *c = e.name; *c; ++c)
+            if (*c == '"' || *c == '\\')
+                out << '\\' << *c;
+            else if (static_cast<unsigned char>(*c) >= 0x20)
+                out << *c;
+        out << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread << std::fixed << std::setprecision(3)
+            << ",\"ts\":" << static_cast<double>(e.begin) * 1e-3 << ",\"dur\":" << static_cast<double>(e.end - e.begin) * 1e-3 << "}";
+        out.unsetf(std::ios::floatfield);
+        first = false;
+    }
+    out << "\n]}\n";
+}
+
+inline auto Profiler::write_chrome_trace(const std::string &path) const -> bool
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    write_chrome_trace(file);
+    return static_cast<bool>(file);
+}
+
+inline auto Profiler::report(std::ostream &out) const -> void
+{
+    out << std::left << std::setw(36) << "zone" << std::right << std::setw(10) << "count" << std::setw(14) << "total ms"
+        << std::setw(12) << "mean ms" << std::setw(12) << "min ms" << std::setw(12) << "max ms" << "\n";
+    out << std::fixed << std::setprecision(3);
+    for (auto &s: stats())
+        out << std::left << std::setw(36) << s.name << std::right << std::setw(10) << s.count << std::setw(14) << s.total_ms
+            << std::setw(12) << s.mean_ms << std::setw(12) << s.min_ms << std::setw(12) << s.max_ms << "\n";
+    out.unsetf(std::ios::floatfield);
+}
+}
+
+#define HINAPE_PROFILE_CONCAT_IMPL(a, b) a##b
+#define HINAPE_PROFILE_CONCAT(a, b) HINAPE_PROFILE_CONCAT_IMPL(a, b)
+#ifdef HINAPE_PROFILE
+#define HINAPE_PROFILE_ZONE(name) ::HinaPE::ProfileZone HINAPE_PROFILE_CONCAT(hinape_profile_zone_, __LINE__)(name)
+#else
+#define HINAPE_PROFILE_ZONE(name) ((void) 0)
+#endif
+
+#endif //HINAPE_PROFILER_H
@@ -0,0 +1,95 @@
+#ifndef HINAPE_SIMD_INTEGRATE_H
+#define HINAPE_SIMD_INTEGRATE_H
+
+#include "vec3_stream.h"
+#include "parallel_lib/parallel_for.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include <vector>
+
+namespace HinaPE
+{
+// Explicit SIMD paths (AVX, else SSE2, else scalar) for the per-vertex integration steps shared by the deformable kernels.
+// Streams are processed one axis at a time, the scalar tail handles sizes that are not a multiple of the register width.
+
+// v += gravity * h for particles with w > 0, then x += v * h
+inline void integrate(Vec3Stream &x, Vec3Stream &v, const std::vector<float> &inv_masses, const Vec3 &gravity, float h);
+
+// v = (x - prev) / h
+inline void update_velocities(Vec3Stream &v, const Vec3Stream &x, const Vec3Stream &prev, float h);
+
+namespace internal
+{
+inline void integrate_axis(float *x, float *v, const float *w, float gh, float h, size_t b, size_t e)
+{
+    size_t i = b;
+#if defined(__AVX__)
+    const __m256 vgh = _mm256_set1_ps(gh), vh = _mm256_set1_ps(h), zero = _mm256_setzero_ps();
+    for (; i + 8 <= e; i += 8)
+    {
+        __m256 free = _mm256_cmp_ps(_mm256_loadu_ps(w + i), zero, _CMP_GT_OQ);
+        __m256 vi = _mm256_add_ps(_mm256_loadu_ps(v + i), _mm256_and_ps(free, vgh));
+        _mm256_storeu_ps(v + i, vi);
+        _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(vi, vh)));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 vgh = _mm_set1_ps(gh), vh = _mm_set1_ps(h), zero = _mm_setzero_ps();
+    for (; i + 4 <= e; i += 4)
+    {
+        __m128 free = _mm_cmpgt_ps(_mm_loadu_ps(w + i), zero);
+        __m128 vi = _mm_add_ps(_mm_loadu_ps(v + i), _mm_and_ps(free, vgh));
+        _mm_storeu_ps(v + i, vi);
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(vi, vh)));
+    }
+#endif
+    for (; i < e; ++i)
+    {
+        if (w[i] > 0)
+            v[i] += gh;
+        x[i] += v[i] * h;
+    }
+}
+
+inline void update_velocities_axis(float *v, const float *x, const float *prev, float inv_h, size_t b, size_t e)
+{
+    size_t i = b;
+#if defined(__AVX__)
+    const __m256 vinv_h = _mm256_set1_ps(inv_h);
+    for (; i + 8 <= e; i += 8)
+        _mm256_storeu_ps(v + i, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(prev + i)), vinv_h));
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 vinv_h = _mm_set1_ps(inv_h);
+    for (; i + 4 <= e; i += 4)
+        _mm_storeu_ps(v + i, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(prev + i)), vinv_h));
+#endif
+    for (; i < e; ++i)
+        v[i] = (x[i] - prev[i]) * inv_h;
+}
+}
+
+inline void integrate(Vec3Stream &x, Vec3Stream &v, const std::vector<float> &inv_masses, const Vec3 &gravity, float h)
+{
+    parallel_range_for(static_cast<size_t>(0), x.size(), [&](size_t b, size_t e)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+            internal::integrate_axis(x.stream(axis).data(), v.stream(axis).data(), inv_masses.data(), gravity[axis] * h, h, b, e);
+    });
+}
+
+inline void update_velocities(Vec3Stream &v, const Vec3Stream &x, const Vec3Stream &prev, float h)
+{
+    const float inv_h = 1.f / h;
+    parallel_range_for(static_cast<size_t>(0), x.size(), [&](size_t b, size_t e)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+            internal::update_velocities_axis(v.stream(axis).data(), x.stream(axis).data(), prev.stream(axis).data(), inv_h, b, e);
+    });
+}
+}
+
+#endif //HINAPE_SIMD_INTEGRATE_H
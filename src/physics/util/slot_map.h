@@ -0,0 +1,165 @@
+#ifndef HINAPE_SLOT_MAP_H
+#define HINAPE_SLOT_MAP_H
+
+#include <cassert>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace HinaPE
+{
+// Generational handle into a SlotMap, stays valid (and detectably stale once erased) while values move around.
+struct SlotHandle
+{
+    unsigned int index = ~0u;
+    unsigned int generation = 0;
+
+    auto operator==(const SlotHandle &) const -> bool = default;
+};
+
+// Values live densely in one array: [0, live) are alive, [live, size) are tombstones (retired, kept for undo).
+// Insert, retire, revive and erase are O(1) and keep both ranges contiguous by swapping with the range boundary.
+template<typename T>
+class SlotMap
+{
+public:
+    auto insert(T value) -> SlotHandle;
+    auto erase(SlotHandle h) -> bool; // free the slot, h becomes stale
+    auto retire(SlotHandle h) -> bool; // alive -> tombstone
+    auto revive(SlotHandle h) -> bool; // tombstone -> alive
+    auto clear() -> void;
+
+    auto get(SlotHandle h) -> T *; // nullptr if stale, tombstones included
+    auto is_alive(SlotHandle h) const -> bool;
+    auto values() -> std::span<T> { return {dense.data(), live}; } // alive values only, densely packed
+    auto values() const -> std::span<const T> { return {dense.data(), live}; }
+    auto tombstones() -> std::span<T> { return {dense.data() + live, dense.size() - live}; }
+    auto size() const -> size_t { return live; }
+
+private:
+    struct Slot
+    {
+        unsigned int dense = 0;
+        unsigned int generation = 0;
+        bool used = false;
+    };
+    auto slot_of(SlotHandle h) const -> const Slot *;
+    auto swap_dense(unsigned int a, unsigned int b) -> void;
+
+    std::vector<T> dense;
+    std::vector<unsigned int> dense_to_slot;
+    std::vector<Slot> slots;
+    std::vector<unsigned int> free_slots;
+    size_t live = 0;
+};
+
+template<typename T>
+auto SlotMap<T>::insert(T value) -> SlotHandle
+{
+    unsigned int index;
+    if (free_slots.empty())
+    {
+        index = static_cast<unsigned int>(slots.size());
+        slots.emplace_back();
+    } else
+    {
+        index = free_slots.back();
+        free_slots.pop_back();
+    }
+
+    // append, then move in front of the tombstones
+    dense.push_back(std::move(value));
+    dense_to_slot.push_back(index);
+    slots[index].dense = static_cast<unsigned int>(dense.size() - 1);
+    slots[index].used = true;
+    swap_dense(slots[index].dense, static_cast<unsigned int>(live));
+    ++live;
+    return {index, slots[index].generation};
+}
+
+template<typename T>
+auto SlotMap<T>::erase(SlotHandle h) -> bool
+{
+    if (!slot_of(h))
+        return false;
+    if (is_alive(h))
+        retire(h);
+    swap_dense(slots[h.index].dense, static_cast<unsigned int>(dense.size() - 1));
+    dense.pop_back();
+    dense_to_slot.pop_back();
+    slots[h.index].used = false;
+    ++slots[h.index].generation;
+    free_slots.push_back(h.index);
+    return true;
+}
+
+template<typename T>
+auto SlotMap<T>::retire(SlotHandle h) -> bool
+{
+    if (!is_alive(h))
+        return false;
+    swap_dense(slots[h.index].dense, static_cast<unsigned int>(live - 1));
+    --live;
+    return true;
+}
+
+template<typename T>
+auto SlotMap<T>::revive(SlotHandle h) -> bool
+{
+    if (!slot_of(h) || is_alive(h))
+        return false;
+    swap_dense(slots[h.index].dense, static_cast<unsigned int>(live));
+    ++live;
+    return true;
+}
+
+template<typename T>
+auto SlotMap<T>::clear() -> void
+{
+    for (unsigned int i = 0; i < slots.size(); ++i)
+        if (slots[i].used)
+        {
+            slots[i].used = false;
+            ++slots[i].generation;
+            free_slots.push_back(i);
+        }
+    dense.clear();
+    dense_to_slot.clear();
+    live = 0;
+}
+
+template<typename T>
+auto SlotMap<T>::get(SlotHandle h) -> T *
+{
+    auto *slot = slot_of(h);
+    return slot ? &dense[slot->dense] : nullptr;
+}
+
+template<typename T>
+auto SlotMap<T>::is_alive(SlotHandle h) const -> bool
+{
+    auto *slot = slot_of(h);
+    return slot && slot->dense < live;
+}
+
+template<typename T>
+auto SlotMap<T>::slot_of(SlotHandle h) const -> const Slot *
+{
+    if (h.index >= slots.size() || !slots[h.index].used || slots[h.index].generation != h.generation)
+        return nullptr;
+    return &slots[h.index];
+}
+
+template<typename T>
+auto SlotMap<T>::swap_dense(unsigned int a, unsigned int b) -> void
+{
+    if (a == b)
+        return;
+    std::swap(dense[a], dense[b]);
+    std::swap(dense_to_slot[a], dense_to_slot[b]);
+    slots[dense_to_slot[a]].dense = a;
+    slots[dense_to_slot[b]].dense = b;
+}
+}
+
+#endif //HINAPE_SLOT_MAP_H
@@ -0,0 +1,110 @@
+#ifndef HINAPE_SNAPSHOT_H
+#define HINAPE_SNAPSHOT_H
+
+#include "vec3_stream.h"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace HinaPE
+{
+// Flat byte image of simulation state: every component writes its fields in a fixed order and reads them back in the
+// same order, whole arrays at a time. The buffer only grows, so a snapshot taken into a recycled buffer costs the
+// memcpy of the state and nothing else.
+struct SnapshotBuffer
+{
+    std::vector<std::byte> bytes; // capacity, only the first size bytes are meaningful
+    size_t size = 0;
+};
+
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(SnapshotBuffer &buffer) : buffer(buffer) { buffer.size = 0; }
+
+    auto bytes(const void *data, size_t size) -> void
+    {
+        if (buffer.size + size > buffer.bytes.size())
+            buffer.bytes.resize(std::max(2 * buffer.bytes.size(), buffer.size + size));
+        if (size > 0)
+            std::memcpy(buffer.bytes.data() + buffer.size, data, size);
+        buffer.size += size;
+    }
+    template<typename T>
+    auto value(const T &v) -> void
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        bytes(&v, sizeof(T));
+    }
+    template<typename T, typename Allocator>
+    auto array(const std::vector<T, Allocator> &v) -> void
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        value(v.size());
+        bytes(v.data(), v.size() * sizeof(T));
+    }
+    auto stream(const Vec3Stream &s) -> void
+    {
+        for (int axis = 0; axis < 3; ++axis)
+            array(s.stream(axis));
+    }
+
+private:
+    SnapshotBuffer &buffer;
+};
+
+// throws std::runtime_error when reading past the end, i.e. the snapshot does not match the state it is loaded into
+class SnapshotReader
+{
+public:
+    explicit SnapshotReader(const SnapshotBuffer &buffer) : data(buffer.bytes.data()), left(buffer.size) {}
+
+    auto bytes(void *out, size_t size) -> void
+    {
+        if (size > left)
+            throw std::runtime_error("snapshot is truncated");
+        if (size > 0)
+            std::memcpy(out, data, size);
+        data += size;
+        left -= size;
+    }
+    template<typename T>
+    auto value(T &v) -> void
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        bytes(&v, sizeof(T));
+    }
+    template<typename T>
+    auto value() -> T
+    {
+        T v;
+        value(v);
+        return v;
+    }
+    template<typename T, typename Allocator>
+    auto array(std::vector<T, Allocator> &v) -> void
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto n = value<size_t>();
+        if (n > left / std::max<size_t>(sizeof(T), 1))
+            throw std::runtime_error("snapshot is truncated");
+        v.resize(n);
+        bytes(v.data(), n * sizeof(T));
+    }
+    auto stream(Vec3Stream &s) -> void
+    {
+        for (int axis = 0; axis < 3; ++axis)
+            array(s.stream(axis));
+    }
+    auto remaining() const -> size_t { return left; }
+
+private:
+    const std::byte *data;
+    size_t left;
+};
+}
+
+#endif //HINAPE_SNAPSHOT_H
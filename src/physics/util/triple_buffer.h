@@ -0,0 +1,47 @@
+#ifndef HINAPE_TRIPLE_BUFFER_H
+#define HINAPE_TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+
+namespace HinaPE
+{
+// Single-producer / single-consumer triple buffer.
+// The producer always owns one slot to write into, the consumer always owns one slot to read from,
+// and the third slot is exchanged atomically between them. Neither side ever waits on the other.
+template<typename T>
+class TripleBuffer
+{
+public:
+    // producer side
+    auto write_buffer() -> T & { return buffers[back]; }
+    auto publish() -> void
+    {
+        auto prev = middle.exchange(back | DIRTY, std::memory_order_acq_rel);
+        back = prev & INDEX;
+    }
+    auto has_unread() const -> bool { return middle.load(std::memory_order_acquire) & DIRTY; }
+
+    // consumer side
+    auto fetch() -> bool // return true if a newer buffer was acquired
+    {
+        if (!(middle.load(std::memory_order_acquire) & DIRTY))
+            return false;
+        auto prev = middle.exchange(front, std::memory_order_acq_rel);
+        front = prev & INDEX;
+        return true;
+    }
+    auto read_buffer() const -> const T & { return buffers[front]; }
+
+private:
+    static constexpr int INDEX = 0b011;
+    static constexpr int DIRTY = 0b100;
+
+    std::array<T, 3> buffers;
+    int front = 0;
+    int back = 1;
+    std::atomic<int> middle{2};
+};
+}
+
+#endif //HINAPE_TRIPLE_BUFFER_H
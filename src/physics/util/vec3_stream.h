@@ -0,0 +1,128 @@
+#ifndef HINAPE_VEC3_STREAM_H
+#define HINAPE_VEC3_STREAM_H
+
+#include "../common.h"
+#include "aligned_allocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace HinaPE
+{
+// An array of Vec3 stored as three 64-byte aligned float streams (x, y, z),
+// each stream can be handed to SIMD loops or viewed by Eigen without copying.
+class Vec3Stream
+{
+public:
+    using Stream = AlignedVector<float>;
+    using Map = Eigen::Map<Eigen::VectorXf, Eigen::Aligned64>;
+    using ConstMap = Eigen::Map<const Eigen::VectorXf, Eigen::Aligned64>;
+
+    Stream x, y, z;
+
+public:
+    auto size() const -> size_t { return x.size(); }
+    auto empty() const -> bool { return x.empty(); }
+    auto resize(size_t n, const Vec3 &value = Vec3()) -> void;
+    auto reserve(size_t n) -> void;
+    auto clear() -> void;
+    auto swap(Vec3Stream &other) noexcept -> void;
+    auto push_back(const Vec3 &v) -> void;
+    auto fill(const Vec3 &v) -> void;
+
+    auto get(size_t i) const -> Vec3 { return Vec3(x[i], y[i], z[i]); }
+    auto set(size_t i, const Vec3 &v) -> void;
+    auto add(size_t i, const Vec3 &v) -> void;
+
+    auto stream(int axis) -> Stream & { return axis == 0 ? x : (axis == 1 ? y : z); }
+    auto stream(int axis) const -> const Stream & { return axis == 0 ? x : (axis == 1 ? y : z); }
+    auto map(int axis) -> Map { return {stream(axis).data(), static_cast<Eigen::Index>(size())}; } // zero-copy view of one axis
+    auto map(int axis) const -> ConstMap { return {stream(axis).data(), static_cast<Eigen::Index>(size())}; }
+
+    auto max_norm() const -> float; // length of the longest vector, 0 if empty
+    auto gather(std::vector<Vec3> &out) const -> void; // interleave into an array of structures, e.g. for rendering
+    auto to_vector() const -> std::vector<Vec3>;
+    auto operator==(const Vec3Stream &) const -> bool = default;
+};
+
+inline auto Vec3Stream::resize(size_t n, const Vec3 &value) -> void
+{
+    x.resize(n, value.x);
+    y.resize(n, value.y);
+    z.resize(n, value.z);
+}
+
+inline auto Vec3Stream::reserve(size_t n) -> void
+{
+    x.reserve(n);
+    y.reserve(n);
+    z.reserve(n);
+}
+
+inline auto Vec3Stream::clear() -> void
+{
+    x.clear();
+    y.clear();
+    z.clear();
+}
+
+inline auto Vec3Stream::swap(Vec3Stream &other) noexcept -> void
+{
+    x.swap(other.x);
+    y.swap(other.y);
+    z.swap(other.z);
+}
+
+inline auto Vec3Stream::push_back(const Vec3 &v) -> void
+{
+    x.push_back(v.x);
+    y.push_back(v.y);
+    z.push_back(v.z);
+}
+
+inline auto Vec3Stream::fill(const Vec3 &v) -> void
+{
+    std::fill(x.begin(), x.end(), v.x);
+    std::fill(y.begin(), y.end(), v.y);
+    std::fill(z.begin(), z.end(), v.z);
+}
+
+inline auto Vec3Stream::set(size_t i, const Vec3 &v) -> void
+{
+    x[i] = v.x;
+    y[i] = v.y;
+    z[i] = v.z;
+}
+
+inline auto Vec3Stream::add(size_t i, const Vec3 &v) -> void
+{
+    x[i] += v.x;
+    y[i] += v.y;
+    z[i] += v.z;
+}
+
+inline auto Vec3Stream::max_norm() const -> float
+{
+    float m = 0;
+    for (size_t i = 0; i < size(); ++i)
+        m = std::max(m, x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+    return std::sqrt(m);
+}
+
+inline auto Vec3Stream::gather(std::vector<Vec3> &out) const -> void
+{
+    out.resize(size());
+    for (size_t i = 0; i < size(); ++i)
+        out[i] = get(i);
+}
+
+inline auto Vec3Stream::to_vector() const -> std::vector<Vec3>
+{
+    std::vector<Vec3> out;
+    gather(out);
+    return out;
+}
+}
+
+#endif //HINAPE_VEC3_STREAM_H
@@ -1,6 +1,7 @@
 #include "pathtracer.h"
 #include "../geometry/util.h"
 #include "../gui/render.h"
+#include "../physics/util/profiler.h"
 
 #include <SDL2/SDL.h>
 #include <thread>
@@ -253,6 +254,7 @@ void Pathtracer::accumulate(const HDR_Image &sample)
 
 void Pathtracer::do_trace(size_t samples)
 {
+    HINAPE_PROFILE_ZONE("pathtracer.do_trace");
 
     HDR_Image sample(out_w, out_h);
     for (size_t j = 0; j < out_h; j++)
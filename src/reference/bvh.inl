@@ -1,5 +1,6 @@
 #include "../rays/bvh.h"
 #include "debug.h"
+#include "../physics/util/profiler.h"
 #include <stack>
 
 namespace PT
@@ -9,6 +10,7 @@ namespace PT
 template<typename Primitive>
 void BVH<Primitive>::build(std::vector<Primitive> &&prims, size_t max_leaf_size)
 {
+    HINAPE_PROFILE_ZONE("bvh.build");
 
     // NOTE (PathTracer):
     // This BVH is parameterized on the type of the primitive it contains. This allows
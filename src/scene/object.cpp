@@ -265,10 +265,27 @@ void Scene_Object::attach_physics_object(std::shared_ptr<HinaPE::PhysicsObject>
 {
     this->physics_object = std::move(o);
     HinaPE::PhysicsSystem::instance()._register_(_id, this->physics_object);
+    set_physics_collider();
+}
+
+void Scene_Object::set_physics_collider()
+{
+    if (!physics_object || !physics_object->is_rigidbody())
+        return;
+    // the scaled mesh is the collision shape, cloths collide with it once the body is switched to static
+    std::vector<Vec3> vertices;
+    std::vector<int> indices;
+    collider_scale = pose.scale;
+    for (auto &v: mesh().verts())
+        vertices.push_back(v.pos * pose.scale);
+    for (auto i: mesh().indices())
+        indices.push_back(static_cast<int>(i));
+    HinaPE::PhysicsSystem::instance().ccd.set_collider(_id, std::move(vertices), std::move(indices));
 }
 
 void Scene_Object::remove_physics_object()
 {
+    HinaPE::PhysicsSystem::instance().ccd.remove_collider(_id);
     this->physics_object = nullptr;
 }
 
@@ -277,10 +294,36 @@ void Scene_Object::sync_physics_result()
     if (!physics_object)
         return;
 
+    // the scale is baked into the collider, rebuild it when an edit changed the scale since
+    if (physics_object->is_rigidbody() && pose.scale != collider_scale)
+        set_physics_collider();
+
+    auto &physics_system = HinaPE::PhysicsSystem::instance();
+    if (physics_system.is_async())
+    {
+        // the solver is running on its own thread, only read its last published state
+        const auto &objects = physics_system._state_().objects;
+        auto it = objects.find(_id);
+        if (it == objects.end())
+            return;
+        if (physics_object->is_rigidbody())
+        {
+            pose.pos = it->second.position;
+            pose.euler = it->second.rotation;
+            set_pose_dirty();
+        } else if (physics_object->is_deformable())
+        {
+            _mesh = Util::Gen::generate(it->second.vertices, physics_object->get_indices());
+            set_mesh_dirty();
+        }
+        return;
+    }
+
     if (physics_object->is_rigidbody())
     {
         Vec3 pos = physics_object->get_position();
         Vec3 rot = physics_object->get_rotation();
+        physics_system._interpolate_(_id, pos, rot);
         pose.pos = pos;
         pose.euler = rot;
         set_pose_dirty();
@@ -291,7 +334,7 @@ void Scene_Object::sync_physics_result()
     {
         auto &verts = physics_object->get_vertices();
         auto &inds = physics_object->get_indices();
-        _mesh = Util::Gen::generate(verts, inds);
+        _mesh = Util::Gen::generate(verts.to_vector(), inds);
         set_mesh_dirty();
         // TODO: enable global pose + local position
         return;
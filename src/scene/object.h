@@ -68,6 +68,7 @@ public:
 
 public:
     void attach_physics_object(std::shared_ptr<HinaPE::PhysicsObject> o);
+    void set_physics_collider(); // hand the mesh to the continuous collision, if the physics object is a rigid body
     void remove_physics_object();
     void sync_physics_result();
     auto get_physics_object_type() const -> HinaPE::PhysicsObjectType;
@@ -104,6 +105,7 @@ private:
 
     mutable GL::Mesh _mesh, _anim_mesh;
     mutable std::vector<std::vector<Joint *>> vertex_joints;
+    Vec3 collider_scale; // the scale the continuous collision collider was built with
 private:
     Vec3 v;
     Vec3 a;
@@ -7,6 +7,7 @@
 #include "../gui/manager.h"
 #include "../gui/render.h"
 #include "../lib/log.h"
+#include "../physics/physics_system.h"
 
 #include "renderer.h"
 #include "scene.h"
@@ -177,8 +178,11 @@ void Scene::restore(Scene_ID id)
     if (objs.find(id) != objs.end())
         return;
     assert(erased.find(id) != erased.end());
-    objs.insert({id, std::move(erased[id])});
+    auto &item = objs.insert({id, std::move(erased[id])}).first->second;
     erased.erase(id);
+    HinaPE::PhysicsSystem::instance()._restore_(id);
+    if (item.is<Scene_Object>())
+        item.get<Scene_Object>().set_physics_collider(); // _erase_ dropped it
 }
 
 void Scene::erase(Scene_ID id)
@@ -188,6 +192,7 @@ void Scene::erase(Scene_ID id)
 
     erased.insert({id, std::move(objs[id])});
     objs.erase(id);
+    HinaPE::PhysicsSystem::instance()._erase_(id);
 }
 
 void Scene::for_items(const std::function<void(const Scene_Item &)>& func) const
@@ -229,6 +234,7 @@ void Scene::clear(Undo &undo)
     next_id = first_id;
     objs.clear();
     erased.clear();
+    HinaPE::PhysicsSystem::instance()._clear_();
     undo.reset();
 }
 
@@ -0,0 +1,80 @@
+// Copyright (c) 2018 Doyub Kim
+//
+// I am making my contributions/submissions to this project solely in my
+// personal capacity and am not conveying any rights to any intellectual
+// property of any third parties.
+
+#ifndef INCLUDE_JET_PARTICLE_NEIGHBOR_LISTS3_H_
+#define INCLUDE_JET_PARTICLE_NEIGHBOR_LISTS3_H_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace jet
+{
+
+//!
+//! \brief Neighbor lists of 3-D particles in compressed sparse row layout.
+//!
+//! The neighbors of all particles are stored back to back in a single index
+//! array, and the neighbors of particle i are the entries from offsets[i] to
+//! offsets[i + 1]. Both arrays keep their capacity when rebuilt, so that a
+//! rebuild every frame does not allocate once the particle count is stable.
+//!
+class ParticleNeighborLists3
+{
+public:
+    //! Returns the neighbor indices of the particle at \p i.
+    std::span<const uint32_t> operator[](size_t i) const
+    {
+        return {_indices.data() + _offsets[i], _offsets[i + 1] - _offsets[i]};
+    }
+
+    //! Returns the number of particles with a neighbor list.
+    size_t size() const
+    {
+        return _offsets.empty() ? 0 : _offsets.size() - 1;
+    }
+
+    //! Returns true if there is no neighbor list.
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    //! Returns the total number of neighbors over all particles.
+    size_t numberOfNeighbors() const
+    {
+        return _indices.size();
+    }
+
+    //! Returns the offsets array with size() + 1 entries.
+    const std::vector<size_t> &offsets() const
+    {
+        return _offsets;
+    }
+
+    //! Returns the neighbor index array.
+    const std::vector<uint32_t> &indices() const
+    {
+        return _indices;
+    }
+
+    //! Removes every list and keeps the memory.
+    void clear()
+    {
+        _offsets.clear();
+        _indices.clear();
+    }
+
+private:
+    friend class ParticleSystemData3;
+
+    std::vector<size_t> _offsets;
+    std::vector<uint32_t> _indices;
+};
+
+}  // namespace jet
+
+#endif  // INCLUDE_JET_PARTICLE_NEIGHBOR_LISTS3_H_
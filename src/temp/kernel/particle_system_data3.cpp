@@ -14,18 +14,34 @@
 #include "fbs_helpers.h"
 #include "generated/particle_system_data3_generated.h"
 
+#include "math_lib/bounding_box3.h"
 #include "math_lib/parallel.h"
 #include "particle_system_data3.h"
 #include "point_parallel_hash_grid_searcher3.h"
 #include "timer.h"
 
 #include <algorithm>
+#include <iterator>
+#include <limits>
+#include <numeric>
 #include <vector>
 
 using namespace jet;
 
 static const size_t kDefaultHashGridResolution = 64;
 
+// Spreads the lower 21 bits of v to every third bit
+static uint64_t spreadBitsBy3(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffff;
+    v = (v | v << 16) & 0x1f0000ff0000ff;
+    v = (v | v << 8) & 0x100f00f00f00f00f;
+    v = (v | v << 4) & 0x10c30c30c30c30c3;
+    v = (v | v << 2) & 0x1249249249249249;
+    return v;
+}
+
 ParticleSystemData3::ParticleSystemData3() : ParticleSystemData3(0)
 {
 }
@@ -53,6 +69,19 @@ ParticleSystemData3::~ParticleSystemData3()
 
 void ParticleSystemData3::resize(size_t newNumberOfParticles)
 {
+    for (size_t i = newNumberOfParticles; i < _numberOfParticles; ++i)
+    {
+        _particleIdToIndex[_particleIds[i]] = kMaxSize;
+    }
+
+    _particleIds.resize(newNumberOfParticles);
+
+    for (size_t i = _numberOfParticles; i < newNumberOfParticles; ++i)
+    {
+        _particleIds[i] = _particleIdToIndex.size();
+        _particleIdToIndex.push_back(i);
+    }
+
     _numberOfParticles = newNumberOfParticles;
 
     for (auto &attr: _scalarDataList)
@@ -200,6 +229,95 @@ void ParticleSystemData3::addParticles(const ConstArrayAccessor1<Vector3D> &newP
     }
 }
 
+void ParticleSystemData3::reorderParticles(double cellSize)
+{
+    size_t n = numberOfParticles();
+    if (n < 2 || cellSize <= 0.0)
+    {
+        return;
+    }
+
+    auto points = positions();
+    BoundingBox3D bound = parallelReduce(kZeroSize, n, BoundingBox3D(), [&](size_t start, size_t end, BoundingBox3D box)
+    {
+        for (size_t i = start; i < end; ++i)
+        {
+            box.merge(points[i]);
+        }
+        return box;
+    }, [](BoundingBox3D a, const BoundingBox3D &b)
+    {
+        a.merge(b);
+        return a;
+    });
+
+    // Cells beyond 2^21 per axis are clamped, the key still fits in 63 bits
+    const size_t kMaxCell = (static_cast<size_t>(1) << 21) - 1;
+    const Vector3D extent = (bound.upperCorner - bound.lowerCorner) / cellSize;
+    size_t maxCell = static_cast<size_t>(std::min(extent.max(), static_cast<double>(kMaxCell)));
+    size_t bitsPerAxis = 1;
+    while ((maxCell >> bitsPerAxis) > 0)
+    {
+        ++bitsPerAxis;
+    }
+    const uint64_t maxKey = (static_cast<uint64_t>(1) << (3 * bitsPerAxis)) - 1;
+
+    std::vector<uint64_t> keys(n);
+    std::vector<size_t> order(n);
+    parallelFor(kZeroSize, n, [&](size_t i)
+    {
+        Vector3D cell = (points[i] - bound.lowerCorner) / cellSize;
+        uint64_t x = std::min(static_cast<size_t>(cell.x), maxCell);
+        uint64_t y = std::min(static_cast<size_t>(cell.y), maxCell);
+        uint64_t z = std::min(static_cast<size_t>(cell.z), maxCell);
+        keys[i] = spreadBitsBy3(x) | (spreadBitsBy3(y) << 1) | (spreadBitsBy3(z) << 2);
+        order[i] = i;
+    });
+
+    parallelRadixSort(keys, order, maxKey);
+
+    // One gather per layer, the old storage is recycled for the next layer
+    ScalarData scalarScratch(n);
+    for (auto &attr: _scalarDataList)
+    {
+        parallelFor(kZeroSize, n, [&](size_t i)
+        {
+            scalarScratch[i] = attr[order[i]];
+        });
+        attr.swap(scalarScratch);
+    }
+
+    VectorData vectorScratch(n);
+    for (auto &attr: _vectorDataList)
+    {
+        parallelFor(kZeroSize, n, [&](size_t i)
+        {
+            vectorScratch[i] = attr[order[i]];
+        });
+        attr.swap(vectorScratch);
+    }
+
+    Array1<size_t> ids(n);
+    parallelFor(kZeroSize, n, [&](size_t i)
+    {
+        ids[i] = _particleIds[order[i]];
+        _particleIdToIndex[ids[i]] = i;
+    });
+    _particleIds.swap(ids);
+
+    _neighborLists.clear();
+}
+
+ConstArrayAccessor1<size_t> ParticleSystemData3::particleIds() const
+{
+    return _particleIds.constAccessor();
+}
+
+size_t ParticleSystemData3::indexOfParticleId(size_t particleId) const
+{
+    return particleId < _particleIdToIndex.size() ? _particleIdToIndex[particleId] : kMaxSize;
+}
+
 const PointNeighborSearcher3Ptr &ParticleSystemData3::neighborSearcher() const
 {
     return _neighborSearcher;
@@ -210,7 +328,7 @@ void ParticleSystemData3::setNeighborSearcher(const PointNeighborSearcher3Ptr &n
     _neighborSearcher = newNeighborSearcher;
 }
 
-const std::vector<std::vector<size_t>> &ParticleSystemData3::neighborLists() const
+const ParticleNeighborLists3 &ParticleSystemData3::neighborLists() const
 {
     return _neighborLists;
 }
@@ -231,22 +349,44 @@ void ParticleSystemData3::buildNeighborLists(double maxSearchRadius)
 {
     Timer timer;
 
-    _neighborLists.resize(numberOfParticles());
+    size_t n = numberOfParticles();
+    JET_ASSERT(n <= std::numeric_limits<uint32_t>::max());
 
+    auto &offsets = _neighborLists._offsets;
+    auto &indices = _neighborLists._indices;
+    offsets.resize(n + 1);
+    offsets[0] = 0;
+
+    // Count the neighbors of each particle, then prefix-sum the counts into
+    // offsets and run the queries again to fill in the indices
     auto points = positions();
-    for (size_t i = 0; i < numberOfParticles(); ++i)
+    parallelFor(kZeroSize, n, [&](size_t i)
     {
-        Vector3D origin = points[i];
-        _neighborLists[i].clear();
+        size_t count = 0;
+        _neighborSearcher->forEachNearbyPoint(points[i], maxSearchRadius, [&](size_t j, const Vector3D &)
+        {
+            if (i != j)
+            {
+                ++count;
+            }
+        });
+        offsets[i + 1] = count;
+    });
 
-        _neighborSearcher->forEachNearbyPoint(origin, maxSearchRadius, [&](size_t j, const Vector3D &)
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    indices.resize(offsets[n]);
+
+    parallelFor(kZeroSize, n, [&](size_t i)
+    {
+        size_t k = offsets[i];
+        _neighborSearcher->forEachNearbyPoint(points[i], maxSearchRadius, [&](size_t j, const Vector3D &)
         {
             if (i != j)
             {
-                _neighborLists[i].push_back(j);
+                indices[k++] = static_cast<uint32_t>(j);
             }
         });
-    }
+    });
 
     JET_INFO << "Building neighbor list took: " << timer.durationInSeconds() << " seconds";
 }
@@ -281,6 +421,8 @@ void ParticleSystemData3::set(const ParticleSystemData3 &other)
     _velocityIdx = other._velocityIdx;
     _forceIdx = other._forceIdx;
     _numberOfParticles = other._numberOfParticles;
+    _particleIds = other._particleIds;
+    _particleIdToIndex = other._particleIdToIndex;
 
     for (auto &attr: other._scalarDataList)
     {
@@ -335,8 +477,9 @@ void ParticleSystemData3::serializeParticleSystemData(flatbuffers::FlatBufferBui
 
     // Copy neighbor lists
     std::vector<flatbuffers::Offset<fbs::ParticleNeighborList3>> neighborLists;
-    for (const auto &neighbors: _neighborLists)
+    for (size_t i = 0; i < _neighborLists.size(); ++i)
     {
+        auto neighbors = _neighborLists[i];
         std::vector<uint64_t> neighbors64(neighbors.begin(), neighbors.end());
         flatbuffers::Offset<fbs::ParticleNeighborList3> fbsNeighborList = fbs::CreateParticleNeighborList3(*builder, builder->CreateVector(neighbors64.data(), neighbors64.size()));
         neighborLists.push_back(fbsNeighborList);
@@ -391,6 +534,15 @@ void ParticleSystemData3::deserializeParticleSystemData(const fbs::ParticleSyste
 
     _numberOfParticles = _vectorDataList[0].size();
 
+    // IDs are not serialized, the particles get them anew in their stored order
+    _particleIds.resize(_numberOfParticles);
+    _particleIdToIndex.resize(_numberOfParticles);
+    for (size_t i = 0; i < _numberOfParticles; ++i)
+    {
+        _particleIds[i] = i;
+        _particleIdToIndex[i] = i;
+    }
+
     // Copy neighbor searcher
     auto fbsNeighborSearcher = fbsParticleSystemData->neighborSearcher();
     _neighborSearcher = Factory::buildPointNeighborSearcher3(fbsNeighborSearcher->type()->c_str());
@@ -399,14 +551,20 @@ void ParticleSystemData3::deserializeParticleSystemData(const fbs::ParticleSyste
 
     // Copy neighbor list
     auto fbsNeighborLists = fbsParticleSystemData->neighborLists();
-    _neighborLists.resize(fbsNeighborLists->size());
-    for (uint32_t i = 0; i < fbsNeighborLists->size(); ++i)
+    _neighborLists.clear();
+    if (fbsNeighborLists->size() > 0)
     {
-        auto fbsNeighborList = fbsNeighborLists->Get(i);
-        _neighborLists[i].resize(fbsNeighborList->data()->size());
-        std::transform(fbsNeighborList->data()->begin(), fbsNeighborList->data()->end(), _neighborLists[i].begin(), [](uint64_t val)
+        auto &offsets = _neighborLists._offsets;
+        auto &indices = _neighborLists._indices;
+        offsets.push_back(0);
+        for (uint32_t i = 0; i < fbsNeighborLists->size(); ++i)
         {
-            return static_cast<size_t>(val);
-        });
+            auto fbsNeighborList = fbsNeighborLists->Get(i);
+            std::transform(fbsNeighborList->data()->begin(), fbsNeighborList->data()->end(), std::back_inserter(indices), [](uint64_t val)
+            {
+                return static_cast<uint32_t>(val);
+            });
+            offsets.push_back(indices.size());
+        }
     }
 }
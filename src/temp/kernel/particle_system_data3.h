@@ -9,6 +9,7 @@
 
 #include "math_lib/array1.h"
 #include "math_lib/serialization.h"
+#include "particle_neighbor_lists3.h"
 #include "point_neighbor_searcher3.h"
 
 #include <memory>
@@ -177,6 +178,37 @@ public:
     //!
     void addParticles(const ConstArrayAccessor1<Vector3D> &newPositions, const ConstArrayAccessor1<Vector3D> &newVelocities = ConstArrayAccessor1<Vector3D>(), const ConstArrayAccessor1<Vector3D> &newForces = ConstArrayAccessor1<Vector3D>());
 
+    //!
+    //! \brief      Reorders the particles along a Z-order curve.
+    //!
+    //! This function sorts the particles by the Morton code of the grid cell
+    //! (of size \p cellSize) they are in, so that particles close in space are
+    //! also close in memory and the neighbor loops stay cache friendly. Every
+    //! scalar and vector data layer is gathered once into the new order. The
+    //! particle IDs move along, see ParticleSystemData3::particleIds. Like
+    //! resizing, this invalidates neighbor searcher and neighbor lists.
+    //!
+    //! \param[in]  cellSize    The size of the grid cells, about the
+    //!                         neighbor search radius.
+    //!
+    void reorderParticles(double cellSize);
+
+    //!
+    //! \brief      Returns the particle IDs.
+    //!
+    //! Every particle gets an ID when it is added, counting up from zero in
+    //! the order the particles were added. The ID of a particle stays the same
+    //! when the particles are reordered, so exporters and emitters can use it
+    //! to follow a particle from frame to frame.
+    //!
+    //! \return     The ID of the particle at each index.
+    //!
+    ConstArrayAccessor1<size_t> particleIds() const;
+
+    //! Returns the current index of the particle with given ID, kMaxSize if
+    //! the particle was removed by resizing.
+    size_t indexOfParticleId(size_t particleId) const;
+
     //!
     //! \brief      Returns neighbor searcher.
     //!
@@ -194,12 +226,12 @@ public:
     //! \brief      Returns neighbor lists.
     //!
     //! This function returns neighbor lists which is available after calling
-    //! PointParallelHashGridSearcher3::buildNeighborLists. Each list stores
-    //! indices of the neighbors.
+    //! ParticleSystemData3::buildNeighborLists. Each list stores indices of
+    //! the neighbors, see ParticleNeighborLists3 for the layout.
     //!
     //! \return     Neighbor lists.
     //!
-    const std::vector<std::vector<size_t>> &neighborLists() const;
+    const ParticleNeighborLists3 &neighborLists() const;
 
     //! Builds neighbor searcher with given search radius.
     void buildNeighborSearcher(double maxSearchRadius);
@@ -235,8 +267,11 @@ private:
     std::vector<ScalarData> _scalarDataList;
     std::vector<VectorData> _vectorDataList;
 
+    Array1<size_t> _particleIds;
+    std::vector<size_t> _particleIdToIndex;
+
     PointNeighborSearcher3Ptr _neighborSearcher;
-    std::vector<std::vector<size_t>> _neighborLists;
+    ParticleNeighborLists3 _neighborLists;
 };
 
 //! Shared pointer type of ParticleSystemData3.
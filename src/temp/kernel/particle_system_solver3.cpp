@@ -11,6 +11,7 @@
 #include "math_lib/parallel.h"
 #include "particle_system_solver3.h"
 #include "timer.h"
+#include "../../physics/util/profiler.h"
 
 #include <algorithm>
 
@@ -99,6 +100,17 @@ void ParticleSystemSolver3::setWind(const VectorField3Ptr &newWind)
     _wind = newWind;
 }
 
+unsigned int ParticleSystemSolver3::reorderingInterval() const
+{
+    return _reorderingInterval;
+}
+
+void ParticleSystemSolver3::setReorderingInterval(unsigned int newInterval)
+{
+    _reorderingInterval = newInterval;
+    _stepsSinceReordering = 0;
+}
+
 void ParticleSystemSolver3::onInitialize()
 {
     // When initializing the solver, update the collider and emitter state as
@@ -114,18 +126,28 @@ void ParticleSystemSolver3::onInitialize()
 
 void ParticleSystemSolver3::onAdvanceTimeStep(double timeStepInSeconds)
 {
+    HINAPE_PROFILE_ZONE("particles3.advance");
     beginAdvanceTimeStep(timeStepInSeconds);
 
     Timer timer;
-    accumulateForces(timeStepInSeconds);
+    {
+        HINAPE_PROFILE_ZONE("particles3.accumulate_forces");
+        accumulateForces(timeStepInSeconds);
+    }
     JET_INFO << "Accumulating forces took " << timer.durationInSeconds() << " seconds";
 
     timer.reset();
-    timeIntegration(timeStepInSeconds);
+    {
+        HINAPE_PROFILE_ZONE("particles3.time_integration");
+        timeIntegration(timeStepInSeconds);
+    }
     JET_INFO << "Time integration took " << timer.durationInSeconds() << " seconds";
 
     timer.reset();
-    resolveCollision();
+    {
+        HINAPE_PROFILE_ZONE("particles3.resolve_collision");
+        resolveCollision();
+    }
     JET_INFO << "Resolving collision took " << timer.durationInSeconds() << " seconds";
 
     endAdvanceTimeStep(timeStepInSeconds);
@@ -154,6 +176,15 @@ void ParticleSystemSolver3::beginAdvanceTimeStep(double timeStepInSeconds)
     updateEmitter(timeStepInSeconds);
     JET_INFO << "Update emitter took " << timer.durationInSeconds() << " seconds";
 
+    // Reorder after emitting, so that the new particles are sorted in too
+    if (_reorderingInterval > 0 && _stepsSinceReordering++ % _reorderingInterval == 0)
+    {
+        HINAPE_PROFILE_ZONE("particles3.reorder");
+        timer.reset();
+        _particleSystemData->reorderParticles(2.0 * _particleSystemData->radius());
+        JET_INFO << "Reordering particles took " << timer.durationInSeconds() << " seconds";
+    }
+
     // Allocate buffers
     size_t n = _particleSystemData->numberOfParticles();
     _newPositions.resize(n);
@@ -111,6 +111,23 @@ public:
     //!
     void setWind(const VectorField3Ptr &newWind);
 
+    //! Returns the number of time-steps between two particle reorderings.
+    unsigned int reorderingInterval() const;
+
+    //!
+    //! \brief      Sets the number of time-steps between two particle
+    //!             reorderings.
+    //!
+    //! When the interval is not zero, the particles are sorted along a
+    //! Z-order curve (see ParticleSystemData3::reorderParticles) at the
+    //! beginning of the first time-step and then of every \p newInterval-th
+    //! time-step, so that neighbors stay close in memory while the particles
+    //! move. Default is 0, which never reorders.
+    //!
+    //! \param[in]  newInterval The new interval.
+    //!
+    void setReorderingInterval(unsigned int newInterval);
+
     //! Returns builder fox ParticleSystemSolver3.
     static Builder builder();
 
@@ -151,6 +168,8 @@ private:
     Collider3Ptr _collider;
     ParticleEmitter3Ptr _emitter;
     VectorField3Ptr _wind;
+    unsigned int _reorderingInterval = 0;
+    unsigned int _stepsSinceReordering = 0;
 
     void beginAdvanceTimeStep(double timeStepInSeconds);
 
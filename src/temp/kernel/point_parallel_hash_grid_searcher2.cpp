@@ -50,9 +50,9 @@ void PointParallelHashGridSearcher2::build(const ConstArrayAccessor1<Vector2D> &
 
     // Allocate memory chuncks
     size_t numberOfPoints = points.size();
-    std::vector<size_t> tempKeys(numberOfPoints);
-    _startIndexTable.resize(_resolution.x * _resolution.y);
-    _endIndexTable.resize(_resolution.x * _resolution.y);
+    const size_t numberOfBuckets = _resolution.x * _resolution.y;
+    _startIndexTable.resize(numberOfBuckets);
+    _endIndexTable.resize(numberOfBuckets);
     parallelFill(_startIndexTable.begin(), _startIndexTable.end(), kMaxSize);
     parallelFill(_endIndexTable.begin(), _endIndexTable.end(), kMaxSize);
     _keys.resize(numberOfPoints);
@@ -68,27 +68,17 @@ void PointParallelHashGridSearcher2::build(const ConstArrayAccessor1<Vector2D> &
     parallelFor(kZeroSize, numberOfPoints, [&](size_t i)
     {
         _sortedIndices[i] = i;
-        _points[i] = points[i];
-        tempKeys[i] = getHashKeyFromPosition(points[i]);
+        _keys[i] = getHashKeyFromPosition(points[i]);
     });
 
-    // Sort indices based on hash key
-    parallelSort(_sortedIndices.begin(), _sortedIndices.end(), [&tempKeys](size_t indexA, size_t indexB)
-    {
-        return tempKeys[indexA] < tempKeys[indexB];
-    });
-
-    // Re-order point and key arrays
-    parallelFor(kZeroSize, numberOfPoints, [&](size_t i)
-    {
-        _points[i] = points[_sortedIndices[i]];
-        _keys[i] = tempKeys[_sortedIndices[i]];
-    });
-
-    // Now _points and _keys are sorted by points' hash key values.
-    // Let's fill in start/end index table with _keys.
+    // Sort (key, index) pairs by key. The keys are bucket indices, so a radix
+    // sort over their significant bytes does it without any comparison. It is
+    // stable: the points of a bucket keep their input order, whatever the
+    // number of threads.
+    parallelRadixSort(_keys, _sortedIndices, numberOfBuckets - 1);
 
-    // Assume that _keys array looks like:
+    // Re-order the points and fill in the start/end index tables in the same
+    // pass. Assume that _keys array looks like:
     // [5|8|8|10|10|10]
     // Then _startIndexTable and _endIndexTable should be like:
     // [.....|0|...|1|..|3|..]
@@ -96,19 +86,24 @@ void PointParallelHashGridSearcher2::build(const ConstArrayAccessor1<Vector2D> &
     //       ^5    ^8   ^10
     // So that _endIndexTable[i] - _startIndexTable[i] is the number points
     // in i-th table bucket.
-
-    _startIndexTable[_keys[0]] = 0;
-    _endIndexTable[_keys[numberOfPoints - 1]] = numberOfPoints;
-
-    parallelFor((size_t) 1, numberOfPoints, [&](size_t i)
+    parallelFor(kZeroSize, numberOfPoints, [&](size_t i)
     {
-        if (_keys[i] > _keys[i - 1])
+        _points[i] = points[_sortedIndices[i]];
+        if (i == 0 || _keys[i] != _keys[i - 1])
         {
             _startIndexTable[_keys[i]] = i;
-            _endIndexTable[_keys[i - 1]] = i;
+        }
+        if (i + 1 == numberOfPoints || _keys[i] != _keys[i + 1])
+        {
+            _endIndexTable[_keys[i]] = i + 1;
         }
     });
 
+    if (!_isLoggingBucketStatistics)
+    {
+        return;
+    }
+
     size_t sumNumberOfPointsPerBucket = 0;
     size_t maxNumberOfPointsPerBucket = 0;
     size_t numberOfNonEmptyBucket = 0;
@@ -127,6 +122,16 @@ void PointParallelHashGridSearcher2::build(const ConstArrayAccessor1<Vector2D> &
     JET_INFO << "Max number of points per bucket: " << maxNumberOfPointsPerBucket;
 }
 
+bool PointParallelHashGridSearcher2::isLoggingBucketStatistics() const
+{
+    return _isLoggingBucketStatistics;
+}
+
+void PointParallelHashGridSearcher2::setIsLoggingBucketStatistics(bool isLogging)
+{
+    _isLoggingBucketStatistics = isLogging;
+}
+
 void PointParallelHashGridSearcher2::forEachNearbyPoint(const Vector2D &origin, double radius, const ForEachNearbyPointFunc &callback) const
 {
     size_t nearbyKeys[4];
@@ -299,6 +304,7 @@ void PointParallelHashGridSearcher2::set(const PointParallelHashGridSearcher2 &o
     _startIndexTable = other._startIndexTable;
     _endIndexTable = other._endIndexTable;
     _sortedIndices = other._sortedIndices;
+    _isLoggingBucketStatistics = other._isLoggingBucketStatistics;
 }
 
 void PointParallelHashGridSearcher2::serialize(std::vector<uint8_t> *buffer) const
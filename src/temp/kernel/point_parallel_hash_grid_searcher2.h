@@ -68,6 +68,12 @@ public:
     //!
     void build(const ConstArrayAccessor1<Vector2D> &points) override;
 
+    //! Returns true if build() logs the bucket occupancy (a serial scan over the whole table).
+    bool isLoggingBucketStatistics() const;
+
+    //! Enables or disables the bucket occupancy log of build(), off by default.
+    void setIsLoggingBucketStatistics(bool isLogging);
+
     //!
     //! Invokes the callback function for each nearby point around the origin
     //! within given radius.
@@ -212,6 +218,7 @@ private:
     std::vector<size_t> _startIndexTable;
     std::vector<size_t> _endIndexTable;
     std::vector<size_t> _sortedIndices;
+    bool _isLoggingBucketStatistics = false;
 
     size_t getHashKeyFromPosition(const Vector2D &position) const;
 
@@ -6,17 +6,33 @@
 #include "math_lib/sphere3.h"
 #include "math_lib/implicit_surface_set3.h"
 #include "math_lib/array_utils.h"
+#include "math_lib/parallel.h"
 #include "sph/sph_solver3.h"
 #include "kernel/volume_particle_emitter3.h"
 
 #include <iostream>
 #include <filesystem>
+#include <numeric>
 using namespace jet;
 
+// Positions by particle ID, so that a line of the file follows the same particle in every frame even when the solver
+// reorders the particles
+void copyPositionsInIdOrder(const ParticleSystemData3Ptr &particles, Array1<Vector3D> *positions)
+{
+    size_t n = particles->numberOfParticles();
+    auto ids = particles->particleIds();
+    auto p = particles->positions();
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), kZeroSize);
+    parallelSort(order.begin(), order.end(), [&](size_t a, size_t b) { return ids[a] < ids[b]; });
+    positions->resize(n);
+    parallelFor(kZeroSize, n, [&](size_t i) { (*positions)[i] = p[order[i]]; });
+}
+
 void saveParticleAsPos(const ParticleSystemData3Ptr &particles, const std::string &rootDir, int frameCnt)
 {
-    Array1<Vector3D> positions(particles->numberOfParticles());
-    copyRange1(particles->positions(), particles->numberOfParticles(), &positions);
+    Array1<Vector3D> positions;
+    copyPositionsInIdOrder(particles, &positions);
     char basename[256];
     snprintf(basename, sizeof(basename), "frame_%06d.pos", frameCnt);
     std::string filename = rootDir + "/" + basename;
@@ -35,8 +51,8 @@ void saveParticleAsPos(const ParticleSystemData3Ptr &particles, const std::strin
 
 void saveParticleAsXyz(const ParticleSystemData3Ptr &particles, const std::string &rootDir, int frameCnt)
 {
-    Array1<Vector3D> positions(particles->numberOfParticles());
-    copyRange1(particles->positions(), particles->numberOfParticles(), &positions);
+    Array1<Vector3D> positions;
+    copyPositionsInIdOrder(particles, &positions);
     char basename[256];
     snprintf(basename, sizeof(basename), "frame_%06d.xyz", frameCnt);
     std::string filename = rootDir + "/" + basename;
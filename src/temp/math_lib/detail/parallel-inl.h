@@ -13,6 +13,7 @@
 #include <algorithm>
 #include <functional>
 #include <future>
+#include <type_traits>
 #include <vector>
 
 #ifdef JET_TASKING_TBB
@@ -30,6 +31,9 @@ namespace jet
 namespace internal
 {
 
+// Slice size of parallelReduce in deterministic mode
+constexpr size_t kDeterministicReduceSlice = 4096;
+
 // NOTE - This abstraction takes a lambda which should take captured
 //        variables by *value* to ensure no captured references race
 //        with the task itself.
@@ -367,6 +371,33 @@ Value parallelReduce(IndexType start, IndexType end, const Value &identity, cons
         return identity;
     }
 
+    if (isDeterministic())
+    {
+        // Fixed slices, whatever the thread count and the policy
+        const IndexType slice = static_cast<IndexType>(internal::kDeterministicReduceSlice);
+        const IndexType numSlices = (end - start + slice - 1) / slice;
+        if (numSlices == 0)
+        {
+            return func(start, end, identity);
+        }
+        std::vector<Value> results(static_cast<size_t>(numSlices), identity);
+        parallelFor(IndexType(0), numSlices, [&](IndexType s)
+        {
+            IndexType i1 = start + s * slice;
+            results[static_cast<size_t>(s)] = func(i1, std::min(i1 + slice, end), identity);
+        }, policy);
+
+        // Balanced merge tree in index order, its shape only depends on the number of slices
+        for (size_t width = 1; width < results.size(); width *= 2)
+        {
+            for (size_t i = 0; i + width < results.size(); i += 2 * width)
+            {
+                results[i] = reduce(results[i], results[i + width]);
+            }
+        }
+        return reduce(results.front(), identity);
+    }
+
 #ifdef JET_TASKING_TBB
     if (policy == ExecutionPolicy::kParallel) {
         return tbb::parallel_reduce(
@@ -472,6 +503,72 @@ void parallelSort(RandomIterator begin, RandomIterator end, ExecutionPolicy poli
     parallelSort(begin, end, std::less<typename std::iterator_traits<RandomIterator>::value_type>(), policy);
 }
 
+template<typename KeyType, typename ValueType>
+void parallelRadixSort(std::vector<KeyType> &keys, std::vector<ValueType> &values, KeyType maxKey, ExecutionPolicy policy)
+{
+    static_assert(std::is_unsigned<KeyType>::value, "radix sort needs unsigned keys");
+    constexpr size_t kRadixBits = 8;
+    constexpr size_t kRadix = size_t(1) << kRadixBits;
+
+    const size_t n = keys.size();
+    if (n < 2)
+    {
+        return;
+    }
+
+    // One slice per thread, each with its own histogram
+    const size_t numSlices = (policy == ExecutionPolicy::kParallel) ? std::max(kOneSize, std::min(static_cast<size_t>(maxNumberOfThreads()), n / kRadix)) : kOneSize;
+    const size_t sliceSize = (n + numSlices - 1) / numSlices;
+    std::vector<size_t> histograms(numSlices * kRadix);
+    std::vector<KeyType> keysTemp(n);
+    std::vector<ValueType> valuesTemp(n);
+
+    for (size_t shift = 0; shift < 8 * sizeof(KeyType) && (maxKey >> shift) > 0; shift += kRadixBits)
+    {
+        std::fill(histograms.begin(), histograms.end(), kZeroSize);
+        parallelFor(kZeroSize, numSlices, [&](size_t s)
+        {
+            size_t *histogram = histograms.data() + s * kRadix;
+            for (size_t i = s * sliceSize; i < std::min(n, (s + 1) * sliceSize); ++i)
+            {
+                ++histogram[(keys[i] >> shift) & (kRadix - 1)];
+            }
+        }, policy);
+
+        // Digit-major, slice-minor offsets keep equal digits in input order
+        size_t offset = 0;
+        bool isIdentity = false;
+        for (size_t d = 0; d < kRadix; ++d)
+        {
+            const size_t digitStart = offset;
+            for (size_t s = 0; s < numSlices; ++s)
+            {
+                size_t count = histograms[s * kRadix + d];
+                histograms[s * kRadix + d] = offset;
+                offset += count;
+            }
+            isIdentity |= (offset - digitStart == n);
+        }
+        if (isIdentity)
+        {
+            continue;  // every key has the same digit here
+        }
+
+        parallelFor(kZeroSize, numSlices, [&](size_t s)
+        {
+            size_t *cursor = histograms.data() + s * kRadix;
+            for (size_t i = s * sliceSize; i < std::min(n, (s + 1) * sliceSize); ++i)
+            {
+                size_t j = cursor[(keys[i] >> shift) & (kRadix - 1)]++;
+                keysTemp[j] = keys[i];
+                valuesTemp[j] = values[i];
+            }
+        }, policy);
+        keys.swap(keysTemp);
+        values.swap(valuesTemp);
+    }
+}
+
 }  // namespace jet
 
 #endif  // INCLUDE_JET_DETAIL_PARALLEL_INL_H_
@@ -6,6 +6,7 @@
 
 #include "parallel.h"
 
+#include <atomic>
 #include <memory>
 #include <thread>
 
@@ -17,6 +18,7 @@
 #endif
 
 static unsigned int sMaxNumberOfThreads = std::thread::hardware_concurrency();
+static std::atomic<bool> sDeterministic = false;
 
 namespace jet
 {
@@ -39,4 +41,8 @@ void setMaxNumberOfThreads(unsigned int numThreads)
 
 unsigned int maxNumberOfThreads() { return sMaxNumberOfThreads; }
 
+void setDeterministic(bool deterministic) { sDeterministic = deterministic; }
+
+bool isDeterministic() { return sDeterministic; }
+
 }  // namespace jet
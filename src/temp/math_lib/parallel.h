@@ -7,6 +7,8 @@
 #ifndef INCLUDE_JET_PARALLEL_H_
 #define INCLUDE_JET_PARALLEL_H_
 
+#include <vector>
+
 namespace jet
 {
 
@@ -211,12 +213,45 @@ void parallelSort(RandomIterator begin, RandomIterator end, ExecutionPolicy poli
 template<typename RandomIterator, typename CompareFunction>
 void parallelSort(RandomIterator begin, RandomIterator end, CompareFunction compare, ExecutionPolicy policy = ExecutionPolicy::kParallel);
 
+//!
+//! \brief      Sorts key-value pairs by bounded unsigned integer keys in parallel.
+//!
+//! This function sorts the pairs (keys[i], values[i]) by key with a least
+//! significant digit radix sort, 8 bits per pass and only as many passes as
+//! maxKey has significant bytes. Every slice of the range counts its digits in
+//! its own histogram, the histograms are prefix-summed in digit-major order and
+//! every slice scatters its pairs, so the sort is stable.
+//!
+//! \param[in,out] keys    The keys, none greater than maxKey.
+//! \param[in,out] values  The values, moved along with their keys.
+//! \param[in]     maxKey  The largest key.
+//! \param[in]     policy  The execution policy (parallel or serial).
+//!
+//! \tparam     KeyType    Unsigned integer key type.
+//! \tparam     ValueType  Value type.
+//!
+template<typename KeyType, typename ValueType>
+void parallelRadixSort(std::vector<KeyType> &keys, std::vector<ValueType> &values, KeyType maxKey, ExecutionPolicy policy = ExecutionPolicy::kParallel);
+
 //! Sets maximum number of threads to use.
 void setMaxNumberOfThreads(unsigned int numThreads);
 
 //! Returns maximum number of threads to use.
 unsigned int maxNumberOfThreads();
 
+//!
+//! \brief      Turns the deterministic mode on or off.
+//!
+//! In deterministic mode parallelReduce splits its range into slices of a
+//! fixed size whatever the number of threads, and merges the slice results
+//! as a balanced tree in index order, so that floating point reductions
+//! give the same bits in serial and parallel runs.
+//!
+void setDeterministic(bool deterministic);
+
+//! Returns true if the deterministic mode is on.
+bool isDeterministic();
+
 }  // namespace jet
 
 #include "detail/parallel-inl.h"
@@ -6,10 +6,12 @@
 
 #include "math_lib/pch.h"
 #include "kernel/physics_helpers.h"
+#include "math_lib/array_utils.h"
 #include "math_lib/parallel.h"
 #include "sph_kernels3.h"
 #include "sph_solver3.h"
 #include "kernel/timer.h"
+#include "../../physics/util/profiler.h"
 
 #include <algorithm>
 
@@ -96,6 +98,20 @@ void SphSolver3::setTimeStepLimitScale(double newScale)
     _timeStepLimitScale = std::max(newScale, 0.0);
 }
 
+auto SphSolver3::neighborListSkin() const -> double { return _neighborListSkin; }
+
+void SphSolver3::setNeighborListSkin(double newSkin)
+{
+    _neighborListSkin = std::max(newSkin, 0.0);
+    _neighborListOrigins.clear();
+    _numberOfNeighborListBuilds = 0;
+    _numberOfNeighborListReuses = 0;
+}
+
+auto SphSolver3::numberOfNeighborListBuilds() const -> size_t { return _numberOfNeighborListBuilds; }
+
+auto SphSolver3::numberOfNeighborListReuses() const -> size_t { return _numberOfNeighborListReuses; }
+
 auto SphSolver3::sphSystemData() const -> SphSystemData3Ptr
 {
     return std::dynamic_pointer_cast<SphSystemData3>(particleSystemData());
@@ -128,8 +144,9 @@ auto SphSolver3::numberOfSubTimeSteps(double timeIntervalInSeconds) const -> uns
 
 void SphSolver3::accumulateForces(double timeStepInSeconds)
 {
-    accumulateNonPressureForces(timeStepInSeconds);
-    accumulatePressureForce(timeStepInSeconds);
+    HINAPE_PROFILE_ZONE("sph3.forces");
+    ParticleSystemSolver3::accumulateForces(timeStepInSeconds);
+    accumulatePairForces(timeStepInSeconds);
 }
 
 void SphSolver3::onBeginAdvanceTimeStep(double timeStepInSeconds)
@@ -139,120 +156,187 @@ void SphSolver3::onBeginAdvanceTimeStep(double timeStepInSeconds)
     auto particles = sphSystemData();
 
     Timer timer;
-    particles->buildNeighborSearcher();
-    particles->buildNeighborLists();
-    particles->updateDensities();
+    if (needsNeighborListRebuild())
+    {
+        // With a skin, the lists also hold the particles that can move into
+        // the kernel radius before the next rebuild. The kernels vanish beyond
+        // the kernel radius, so the extra pairs add nothing to the sums.
+        const double searchRadius = particles->kernelRadius() + _neighborListSkin;
+        {
+            HINAPE_PROFILE_ZONE("sph3.build_neighbor_searcher");
+            particles->ParticleSystemData3::buildNeighborSearcher(searchRadius);
+        }
+        {
+            HINAPE_PROFILE_ZONE("sph3.build_neighbor_lists");
+            particles->ParticleSystemData3::buildNeighborLists(searchRadius);
+        }
+
+        if (_neighborListSkin > 0.0)
+        {
+            size_t n = particles->numberOfParticles();
+            _neighborListOrigins.resize(n);
+            copyRange1(particles->positions(), n, &_neighborListOrigins);
+            _neighborListSearchRadius = searchRadius;
+        }
+        ++_numberOfNeighborListBuilds;
+    } else
+    {
+        ++_numberOfNeighborListReuses;
+    }
+    updatePairTermsAndDensities();
 
     JET_INFO << "Building neighbor lists and updating densities took " << timer.durationInSeconds() << " seconds";
+    if (_neighborListSkin > 0.0)
+    {
+        JET_INFO << "Neighbor lists built " << _numberOfNeighborListBuilds << " times in " << _numberOfNeighborListBuilds + _numberOfNeighborListReuses << " time-steps";
+    }
 }
 
-void SphSolver3::onEndAdvanceTimeStep(double timeStepInSeconds)
+auto SphSolver3::needsNeighborListRebuild() const -> bool
 {
-    computePseudoViscosity(timeStepInSeconds);
+    if (_neighborListSkin <= 0.0)
+    {
+        return true;
+    }
 
+    // Emitting or reordering particles, or changing the kernel radius, makes
+    // the lists stale whatever the displacements
     auto particles = sphSystemData();
-    size_t numberOfParticles = particles->numberOfParticles();
-    auto densities = particles->densities();
-
-    double maxDensity = 0.0;
-    for (size_t i = 0; i < numberOfParticles; ++i)
+    size_t n = particles->numberOfParticles();
+    if (particles->neighborLists().size() != n || _neighborListOrigins.size() != n || _neighborListSearchRadius != particles->kernelRadius() + _neighborListSkin)
     {
-        maxDensity = std::max(maxDensity, densities[i]);
+        return true;
     }
 
-    JET_INFO << "Max density: " << maxDensity << " " << "Max density / target density ratio: " << maxDensity / particles->targetDensity();
-}
+    HINAPE_PROFILE_ZONE("sph3.check_displacements");
+    auto x = particles->positions();
+    double maxDisplacementSquared = parallelReduce(kZeroSize, n, 0.0, [&](size_t start, size_t end, double result)
+    {
+        for (size_t i = start; i < end; ++i)
+        {
+            result = std::max(result, x[i].distanceSquaredTo(_neighborListOrigins[i]));
+        }
+        return result;
+    }, [](double a, double b)
+    {
+        return std::max(a, b);
+    });
 
-void SphSolver3::accumulateNonPressureForces(double timeStepInSeconds)
-{
-    ParticleSystemSolver3::accumulateForces(timeStepInSeconds);
-    accumulateViscosityForce();
+    // The distance of a pair shrinks by at most twice the largest displacement
+    return maxDisplacementSquared > square(0.5 * _neighborListSkin);
 }
 
-void SphSolver3::accumulatePressureForce(double timeStepInSeconds)
+void SphSolver3::updatePairTermsAndDensities()
 {
-    UNUSED_VARIABLE(timeStepInSeconds);
-
+    HINAPE_PROFILE_ZONE("sph3.update_pair_terms_and_densities");
     auto particles = sphSystemData();
+    size_t numberOfParticles = particles->numberOfParticles();
+    const auto &neighborLists = particles->neighborLists();
     auto x = particles->positions();
     auto d = particles->densities();
-    auto p = particles->pressures();
-    auto f = particles->forces();
 
-    computePressure();
-    accumulatePressureForce(x, d, p, f);
+    const double mass = particles->mass();
+    const SphStdKernel3 stdKernel(particles->kernelRadius());
+    const SphSpikyKernel3 spikyKernel(particles->kernelRadius());
+
+    size_t numberOfPairs = neighborLists.numberOfNeighbors();
+    _pairGradients.resize(numberOfPairs);
+    _pairSecondDerivatives.resize(numberOfPairs);
+
+    const auto &offsets = neighborLists.offsets();
+    const auto &indices = neighborLists.indices();
+    parallelFor(kZeroSize, numberOfParticles, [&](size_t i)
+    {
+        double sum = stdKernel(0.0);
+        for (size_t k = offsets[i]; k < offsets[i + 1]; ++k)
+        {
+            size_t j = indices[k];
+            double dist = x[i].distanceTo(x[j]);
+            sum += stdKernel(dist);
+
+            _pairGradients[k] = dist > 0.0 ? spikyKernel.gradient(dist, (x[j] - x[i]) / dist) : Vector3D();
+            _pairSecondDerivatives[k] = spikyKernel.secondDerivative(dist);
+        }
+        d[i] = mass * sum;
+    });
 }
 
-void SphSolver3::computePressure() const
+void SphSolver3::onEndAdvanceTimeStep(double timeStepInSeconds)
 {
+    HINAPE_PROFILE_ZONE("sph3.end_advance");
+    computePseudoViscosity(timeStepInSeconds);
+
     auto particles = sphSystemData();
     size_t numberOfParticles = particles->numberOfParticles();
-    auto d = particles->densities();
-    auto p = particles->pressures();
-
-    // See Murnaghan-Tait equation of state from
-    // https://en.wikipedia.org/wiki/Tait_equation
-    const double targetDensity = particles->targetDensity();
-    const double eosScale = targetDensity * square(_speedOfSound);
+    auto densities = particles->densities();
 
-    parallelFor(kZeroSize, numberOfParticles, [&](size_t i)
+    double maxDensity = 0.0;
+    for (size_t i = 0; i < numberOfParticles; ++i)
     {
-        p[i] = computePressureFromEos(d[i], targetDensity, eosScale, eosExponent(), negativePressureScale());
-    });
+        maxDensity = std::max(maxDensity, densities[i]);
+    }
+
+    JET_INFO << "Max density: " << maxDensity << " " << "Max density / target density ratio: " << maxDensity / particles->targetDensity();
 }
 
-void SphSolver3::accumulatePressureForce(const ConstArrayAccessor1<Vector3D> &positions, const ConstArrayAccessor1<double> &densities, const ConstArrayAccessor1<double> &pressures, ArrayAccessor1<Vector3D> pressureForces) const
+void SphSolver3::accumulatePairForces(double timeStepInSeconds)
 {
+    HINAPE_PROFILE_ZONE("sph3.pair_forces");
+    UNUSED_VARIABLE(timeStepInSeconds);
+
     auto particles = sphSystemData();
     size_t numberOfParticles = particles->numberOfParticles();
+    const auto &offsets = particles->neighborLists().offsets();
+    const auto &indices = particles->neighborLists().indices();
+    auto v = particles->velocities();
+    auto d = particles->densities();
+    auto p = particles->pressures();
+    auto f = particles->forces();
 
     const double massSquared = square(particles->mass());
-    const SphSpikyKernel3 kernel(particles->kernelRadius());
+    const double viscosity = viscosityCoefficient();
 
+    computePressure();
     parallelFor(kZeroSize, numberOfParticles, [&](size_t i)
     {
-        const auto &neighbors = particles->neighborLists()[i];
-        for (size_t j: neighbors)
+        const double pi = p[i] / (d[i] * d[i]);
+        Vector3D force;
+        for (size_t k = offsets[i]; k < offsets[i + 1]; ++k)
         {
-            double dist = positions[i].distanceTo(positions[j]);
-
-            if (dist > 0.0)
-            {
-                Vector3D dir = (positions[j] - positions[i]) / dist;
-                pressureForces[i] -= massSquared * (pressures[i] / (densities[i] * densities[i]) + pressures[j] / (densities[j] * densities[j])) * kernel.gradient(dist, dir);
-            }
+            size_t j = indices[k];
+            force -= (pi + p[j] / (d[j] * d[j])) * _pairGradients[k];
+            force += viscosity * (v[j] - v[i]) / d[j] * _pairSecondDerivatives[k];
         }
+        f[i] += massSquared * force;
     });
 }
 
-void SphSolver3::accumulateViscosityForce() const
+void SphSolver3::computePressure() const
 {
+    HINAPE_PROFILE_ZONE("sph3.compute_pressure");
     auto particles = sphSystemData();
     size_t numberOfParticles = particles->numberOfParticles();
-    auto x = particles->positions();
-    auto v = particles->velocities();
     auto d = particles->densities();
-    auto f = particles->forces();
+    auto p = particles->pressures();
 
-    const double massSquared = square(particles->mass());
-    const SphSpikyKernel3 kernel(particles->kernelRadius());
+    // See Murnaghan-Tait equation of state from
+    // https://en.wikipedia.org/wiki/Tait_equation
+    const double targetDensity = particles->targetDensity();
+    const double eosScale = targetDensity * square(_speedOfSound);
 
     parallelFor(kZeroSize, numberOfParticles, [&](size_t i)
     {
-        const auto &neighbors = particles->neighborLists()[i];
-        for (size_t j: neighbors)
-        {
-            double dist = x[i].distanceTo(x[j]);
-
-            f[i] += viscosityCoefficient() * massSquared * (v[j] - v[i]) / d[j] * kernel.secondDerivative(dist);
-        }
+        p[i] = computePressureFromEos(d[i], targetDensity, eosScale, eosExponent(), negativePressureScale());
     });
 }
 
 void SphSolver3::computePseudoViscosity(double timeStepInSeconds) const
 {
+    HINAPE_PROFILE_ZONE("sph3.pseudo_viscosity");
     auto particles = sphSystemData();
     size_t numberOfParticles = particles->numberOfParticles();
+    const auto &offsets = particles->neighborLists().offsets();
+    const auto &indices = particles->neighborLists().indices();
     auto x = particles->positions();
     auto v = particles->velocities();
     auto d = particles->densities();
@@ -267,9 +351,9 @@ void SphSolver3::computePseudoViscosity(double timeStepInSeconds) const
         double weightSum = 0.0;
         Vector3D smoothedVelocity;
 
-        const auto &neighbors = particles->neighborLists()[i];
-        for (size_t j: neighbors)
+        for (size_t k = offsets[i]; k < offsets[i + 1]; ++k)
         {
+            size_t j = indices[k];
             double dist = x[i].distanceTo(x[j]);
             double wj = mass / d[j] * kernel(dist);
             weightSum += wj;
@@ -113,6 +113,29 @@ public:
     //!
     void setTimeStepLimitScale(double newScale);
 
+    //! Returns the skin added to the kernel radius of the neighbor lists.
+    auto neighborListSkin() const -> double;
+
+    //!
+    //! \brief Sets the skin added to the kernel radius of the neighbor lists.
+    //!
+    //! With a positive skin, the neighbor searcher and the neighbor lists are
+    //! built with the kernel radius plus the skin, and the lists are reused
+    //! for the next time-steps until a particle moves more than half of the
+    //! skin from where it was at the last build (Verlet lists). The neighbor
+    //! searcher is not rebuilt either in between, so it lags behind the
+    //! particles. Default is 0, which rebuilds every time-step.
+    //!
+    void setNeighborListSkin(double newSkin);
+
+    //! Returns the number of time-steps that built the neighbor lists since
+    //! the skin was set.
+    auto numberOfNeighborListBuilds() const -> size_t;
+
+    //! Returns the number of time-steps that reused the neighbor lists since
+    //! the skin was set.
+    auto numberOfNeighborListReuses() const -> size_t;
+
     //! Returns the SPH system data.
     auto sphSystemData() const -> SphSystemData3Ptr;
 
@@ -132,28 +155,38 @@ protected:
     //! Performs post-processing step before the simulation.
     void onEndAdvanceTimeStep(double timeStepInSeconds) override;
 
-    //! Accumulates the non-pressure forces to the forces array in the particle
-    //! system.
-    virtual void accumulateNonPressureForces(double timeStepInSeconds);
-
-    //! Accumulates the pressure force to the forces array in the particle
-    //! system.
-    virtual void accumulatePressureForce(double timeStepInSeconds);
+    //!
+    //! \brief Accumulates the pressure and viscosity forces to the forces
+    //!        array in the particle system.
+    //!
+    //! Both forces are summed in a single sweep over the neighbor lists, with
+    //! the kernel terms cached by updatePairTermsAndDensities. Solvers with a
+    //! different pressure solve override this function.
+    //!
+    virtual void accumulatePairForces(double timeStepInSeconds);
 
     //! Computes the pressure.
     void computePressure() const;
 
-    //! Accumulates the pressure force to the given \p pressureForces array.
-    void accumulatePressureForce(const ConstArrayAccessor1<Vector3D> &positions, const ConstArrayAccessor1<double> &densities, const ConstArrayAccessor1<double> &pressures, ArrayAccessor1<Vector3D> pressureForces) const;
-
-    //! Accumulates the viscosity force to the forces array in the particle
-    //! system.
-    void accumulateViscosityForce() const;
-
     //! Computes pseudo viscosity.
     void computePseudoViscosity(double timeStepInSeconds) const;
 
+    //!
+    //! \brief Computes the kernel terms of every neighbor pair and the
+    //!        densities.
+    //!
+    //! Distances and kernels are evaluated once per pair with the positions
+    //! of the beginning of the time-step. The spiky kernel gradient and second
+    //! derivative of each pair are cached in neighbor list order for
+    //! accumulatePairForces. The pseudo viscosity weights are evaluated at the
+    //! integrated positions instead.
+    //!
+    void updatePairTermsAndDensities();
+
 private:
+    //! Returns true if the neighbor lists have to be built this time-step.
+    auto needsNeighborListRebuild() const -> bool;
+
     //! Exponent component of equation-of-state (or Tait's equation).
     double _eosExponent = 7.0;
 
@@ -176,6 +209,21 @@ private:
 
     //! Scales the max allowed time-step.
     double _timeStepLimitScale = 1.0;
+
+    //! Skin of the neighbor lists, zero rebuilds them every time-step.
+    double _neighborListSkin = 0.0;
+
+    //! Search radius and particle positions at the last neighbor list build.
+    double _neighborListSearchRadius = 0.0;
+    Array1<Vector3D> _neighborListOrigins;
+
+    size_t _numberOfNeighborListBuilds = 0;
+    size_t _numberOfNeighborListReuses = 0;
+
+    //! Spiky kernel terms of the neighbor pairs, see
+    //! updatePairTermsAndDensities.
+    Array1<Vector3D> _pairGradients;
+    Array1<double> _pairSecondDerivatives;
 };
 
 //! Shared pointer type for the SphSolver3.
@@ -78,6 +78,26 @@ void SphSystemData3::updateDensities()
     auto d = densities();
     const double m = mass();
 
+    // Walk the flat neighbor lists when they are built, the particle itself
+    // is not in its list and contributes the kernel value at zero distance
+    const auto &lists = neighborLists();
+    if (lists.size() == numberOfParticles())
+    {
+        const auto &offsets = lists.offsets();
+        const auto &indices = lists.indices();
+        SphStdKernel3 kernel(_kernelRadius);
+        parallelFor(kZeroSize, numberOfParticles(), [&](size_t i)
+        {
+            double sum = kernel(0.0);
+            for (size_t k = offsets[i]; k < offsets[i + 1]; ++k)
+            {
+                sum += kernel(p[i].distanceTo(p[indices[k]]));
+            }
+            d[i] = m * sum;
+        });
+        return;
+    }
+
     parallelFor(kZeroSize, numberOfParticles(), [&](size_t i)
     {
         double sum = sumOfKernelNearby(p[i]);
@@ -180,7 +200,7 @@ auto SphSystemData3::gradientAt(size_t i, const ConstArrayAccessor1<double> &val
     Vector3D sum;
     auto p = positions();
     auto d = densities();
-    const auto &neighbors = neighborLists()[i];
+    auto neighbors = neighborLists()[i];
     const Vector3D &origin = p[i];
     SphSpikyKernel3 kernel(_kernelRadius);
     const double m = mass();
@@ -204,7 +224,7 @@ auto SphSystemData3::laplacianAt(size_t i, const ConstArrayAccessor1<double> &va
     double sum = 0.0;
     auto p = positions();
     auto d = densities();
-    const auto &neighbors = neighborLists()[i];
+    auto neighbors = neighborLists()[i];
     const Vector3D &origin = p[i];
     SphSpikyKernel3 kernel(_kernelRadius);
     const double m = mass();
@@ -224,7 +244,7 @@ auto SphSystemData3::laplacianAt(size_t i, const ConstArrayAccessor1<Vector3D> &
     Vector3D sum;
     auto p = positions();
     auto d = densities();
-    const auto &neighbors = neighborLists()[i];
+    auto neighbors = neighborLists()[i];
     const Vector3D &origin = p[i];
     SphSpikyKernel3 kernel(_kernelRadius);
     const double m = mass();
@@ -66,7 +66,9 @@ public:
     //! Returns the pressure array accessor (mutable).
     auto pressures() -> ArrayAccessor1<double>;
 
-    //! Updates the density array with the latest particle positions.
+    //! Updates the density array with the latest particle positions. Walks
+    //! the neighbor lists if they are built, queries the neighbor searcher
+    //! otherwise.
     void updateDensities();
 
     //! Sets the target density of this particle system.